@@ -0,0 +1,288 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief Benchmark suite of the casting and compositing hot paths.
+ * @details Generates the same scenes on every run (random segments, grid
+ * mazes and fields of rectangles) from 100 up to 100k edges, and times the
+ * casts of the lights, the rays and the LightingArea with them. The results
+ * are printed as CSV, one line per case:
+ *
+ *     benchmark,scene,edges,param,ns_per_op,rays_per_s
+ *
+ * `param` is the beam angle, edge container or number of lights of the
+ * case, and `rays_per_s` is empty when it doesn't apply.
+ *
+ * Usage: `candle-bench [maxEdges] [minSeconds]`. Each case is repeated
+ * until it has run for at least `minSeconds` (0.1 by default).
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "SFML/Graphics.hpp"
+
+#include "Candle/RadialLight.hpp"
+#include "Candle/DirectedLight.hpp"
+#include "Candle/LightBatch.hpp"
+#include "Candle/LightingArea.hpp"
+#include "Candle/EdgeIndex.hpp"
+#include "Candle/EdgeBuffer.hpp"
+#include "Candle/geometry/Line.hpp"
+#include "Candle/geometry/Polygon.hpp"
+
+namespace{
+    const float CELL = 32.f;
+    const float RANGE = 300.f;
+    double s_minSeconds = 0.1;
+
+    struct Scene{
+        std::string name;
+        candle::EdgeVector edges;
+        float side;
+    };
+
+    // The scenes grow with the number of edges, keeping the density, so a
+    // light has about the same edges in range in all of them
+    float sideFor(unsigned int edges){
+        return CELL * std::ceil(std::sqrt((float)edges));
+    }
+
+    Scene randomSegments(unsigned int n, unsigned int seed){
+        Scene scene{"segments", {}, sideFor(n)};
+        std::mt19937 gen(seed);
+        std::uniform_real_distribution<float> pos(0.f, scene.side);
+        std::uniform_real_distribution<float> len(-CELL/2, CELL/2);
+        for(unsigned int i = 0; i < n; i++){
+            sf::Vector2f p(pos(gen), pos(gen));
+            scene.edges.emplace_back(p, p + sf::Vector2f(len(gen), len(gen)));
+        }
+        return scene;
+    }
+
+    Scene gridMaze(unsigned int n, unsigned int seed){
+        Scene scene{"maze", {}, sideFor(n)};
+        std::mt19937 gen(seed);
+        std::bernoulli_distribution wall(0.5);
+        int cells = scene.side / CELL;
+        for(int y = 0; y < cells && scene.edges.size() < n; y++){
+            for(int x = 0; x < cells && scene.edges.size() < n; x++){
+                sf::Vector2f p(x * CELL, y * CELL);
+                if(wall(gen)){
+                    scene.edges.emplace_back(p, p + sf::Vector2f(CELL, 0.f));
+                }else{
+                    scene.edges.emplace_back(p, p + sf::Vector2f(0.f, CELL));
+                }
+            }
+        }
+        return scene;
+    }
+
+    Scene rectangleField(unsigned int n, unsigned int seed){
+        Scene scene{"rectangles", {}, sideFor(n)};
+        std::mt19937 gen(seed);
+        std::uniform_real_distribution<float> pos(0.f, scene.side);
+        std::uniform_real_distribution<float> size(CELL/4, CELL*3/4);
+        while(scene.edges.size() + 4 <= n){
+            sf::Vector2f p(pos(gen), pos(gen));
+            sf::Vector2f s(size(gen), size(gen));
+            const sf::Vector2f points[] = {p, p + sf::Vector2f(s.x, 0.f), p + s, p + sf::Vector2f(0.f, s.y)};
+            sfu::Polygon polygon(points, 4);
+            scene.edges.insert(scene.edges.end(), polygon.lines.begin(), polygon.lines.end());
+        }
+        return scene;
+    }
+
+    // Runs f until s_minSeconds have passed, and returns the nanoseconds
+    // per call
+    template <typename Function>
+    double timeOp(Function f){
+        f(); // warm up the scratch buffers
+        unsigned long calls = 0;
+        double elapsed = 0.;
+        auto t0 = std::chrono::steady_clock::now();
+        do{
+            f();
+            calls++;
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        }while(elapsed < s_minSeconds);
+        return elapsed * 1e9 / calls;
+    }
+
+    void report(const char* benchmark, const std::string& scene, unsigned int edges, const std::string& param, double ns, double raysPerOp){
+        std::printf("%s,%s,%u,%s,%.1f,", benchmark, scene.c_str(), edges, param.c_str(), ns);
+        if(raysPerOp > 0.){
+            std::printf("%.0f", raysPerOp * 1e9 / ns);
+        }
+        std::printf("\n");
+    }
+
+    // Triangles of the polygon of the light, one for each ray casted
+    unsigned int countRays(const candle::RadialLight& light){
+        candle::LightBatch batch;
+        batch.add(light);
+        return batch.getVertexCount() / 3;
+    }
+
+    void benchRadial(const Scene& scene, const candle::EdgeIndex& index, const candle::EdgeBuffer& buffer){
+        unsigned int n = scene.edges.size();
+        candle::EdgeVector edges(scene.edges);
+        const float beams[] = {360.f, 180.f, 90.f};
+        for(float beam: beams){
+            candle::RadialLight light;
+            light.setRange(RANGE);
+            light.setBeamAngle(beam);
+            light.setPosition(scene.side/2, scene.side/2);
+            std::string param = std::to_string((int)beam);
+            double ns = timeOp([&]{ light.castLight(edges.begin(), edges.end()); });
+            report("radial", scene.name, n, param + "/vector", ns, countRays(light));
+            ns = timeOp([&]{ light.castLight(index); });
+            report("radial", scene.name, n, param + "/index", ns, countRays(light));
+            ns = timeOp([&]{ light.castLight(buffer); });
+            report("radial", scene.name, n, param + "/buffer", ns, countRays(light));
+        }
+    }
+
+    void benchDirected(const Scene& scene, const candle::EdgeIndex& index){
+        unsigned int n = scene.edges.size();
+        candle::EdgeVector edges(scene.edges);
+        candle::DirectedLight light;
+        light.setRange(RANGE);
+        light.setBeamWidth(RANGE);
+        light.setPosition(scene.side/2 - RANGE/2, scene.side/2);
+        double ns = timeOp([&]{ light.castLight(edges.begin(), edges.end()); });
+        report("directed", scene.name, n, "vector", ns, 0.);
+        ns = timeOp([&]{ light.castLight(index); });
+        report("directed", scene.name, n, "index", ns, 0.);
+    }
+
+    void benchCastRay(const Scene& scene, const candle::EdgeIndex& index, const candle::EdgeBuffer& buffer){
+        const unsigned int RAYS = 256;
+        unsigned int n = scene.edges.size();
+        std::mt19937 gen(7);
+        std::uniform_real_distribution<float> pos(0.f, scene.side);
+        std::uniform_real_distribution<float> ang(0.f, 360.f);
+        std::vector<sfu::Line> rays;
+        for(unsigned int i = 0; i < RAYS; i++){
+            rays.emplace_back(sf::Vector2f(pos(gen), pos(gen)), ang(gen));
+        }
+        volatile float sink = 0.f;
+        double ns = timeOp([&]{
+            for(auto& r: rays){
+                sink = sink + sfu::castRay(scene.edges.begin(), scene.edges.end(), r, RANGE).x;
+            }
+        });
+        report("castRay", scene.name, n, "vector", ns / RAYS, 1.);
+        ns = timeOp([&]{
+            for(auto& r: rays){
+                float t;
+                sink = sink + index.castRay(r, RANGE, t);
+            }
+        });
+        report("castRay", scene.name, n, "index", ns / RAYS, 1.);
+        ns = timeOp([&]{
+            for(auto& r: rays){
+                sink = sink + candle::castRayDistance(buffer, r, RANGE);
+            }
+        });
+        report("castRay", scene.name, n, "buffer", ns / RAYS, 1.);
+    }
+
+    void benchIntersection(){
+        const unsigned int SEGMENTS = 1024;
+        std::mt19937 gen(11);
+        std::uniform_real_distribution<float> pos(0.f, 1000.f);
+        std::uniform_real_distribution<float> len(-40.f, 40.f);
+        std::uniform_real_distribution<float> ang(0.f, 360.f);
+        std::vector<sfu::Line> segments;
+        for(unsigned int i = 0; i < SEGMENTS; i++){
+            sf::Vector2f p(pos(gen), pos(gen));
+            segments.emplace_back(p, p + sf::Vector2f(len(gen), len(gen)));
+        }
+        sfu::Line ray(sf::Vector2f(pos(gen), pos(gen)), ang(gen));
+        volatile unsigned long sink = 0;
+        double ns = timeOp([&]{
+            for(auto& s: segments){
+                float t1, t2;
+                sink = sink + (s.intersection(ray, t1, t2) == sfu::Line::SECANT);
+            }
+        });
+        report("intersection", "segments", SEGMENTS, "Line::intersection", ns / SEGMENTS, 0.);
+        ns = timeOp([&]{
+            for(auto& s: segments){
+                float t;
+                sink = sink + sfu::intersectSegmentRay(s, ray, t);
+            }
+        });
+        report("intersection", "segments", SEGMENTS, "intersectSegmentRay", ns / SEGMENTS, 0.);
+    }
+
+    // One frame of a fog: clear, draw every light and display
+    void benchLightingArea(const Scene& scene, const candle::EdgeIndex& index){
+        const unsigned int counts[] = {1, 16, 256};
+        unsigned int n = scene.edges.size();
+        std::mt19937 gen(13);
+        std::uniform_real_distribution<float> pos(0.f, scene.side);
+        for(unsigned int count: counts){
+            std::vector<std::unique_ptr<candle::RadialLight>> lights;
+            for(unsigned int i = 0; i < count; i++){
+                lights.emplace_back(new candle::RadialLight());
+                lights.back()->setRange(RANGE);
+                lights.back()->setPosition(pos(gen), pos(gen));
+                lights.back()->castLight(index);
+            }
+            candle::LightingArea area(candle::LightingArea::FOG, sf::Vector2f(0.f, 0.f), sf::Vector2f(scene.side, scene.side));
+            double ns = timeOp([&]{
+                area.clear();
+                for(auto& light: lights){
+                    area.draw(*light);
+                }
+                area.display();
+            });
+            report("area", scene.name, n, std::to_string(count) + " lights", ns, 0.);
+            candle::LightBatch batch;
+            ns = timeOp([&]{
+                batch.clear();
+                for(auto& light: lights){
+                    batch.add(*light);
+                }
+                area.clear();
+                area.draw(batch);
+                area.display();
+            });
+            report("area", scene.name, n, std::to_string(count) + " lights/batch", ns, 0.);
+        }
+    }
+}
+
+int main(int argc, char** argv){
+    unsigned int maxEdges = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    if(argc > 2){
+        s_minSeconds = std::strtod(argv[2], nullptr);
+    }
+    std::printf("benchmark,scene,edges,param,ns_per_op,rays_per_s\n");
+    benchIntersection();
+    for(unsigned int n = 100; n <= maxEdges; n *= 10){
+        Scene scenes[] = {randomSegments(n, n), gridMaze(n, n), rectangleField(n, n)};
+        for(auto& scene: scenes){
+            candle::EdgeIndex index(scene.edges.begin(), scene.edges.end(), CELL * 2);
+            candle::EdgeBuffer buffer(scene.edges.begin(), scene.edges.end());
+            benchRadial(scene, index, buffer);
+            benchDirected(scene, index);
+            benchCastRay(scene, index, buffer);
+            // The area is as big as the scene, so only up to the maximum
+            // texture size
+            if(scene.side <= sf::Texture::getMaximumSize()){
+                benchLightingArea(scene, index);
+            }
+            std::fflush(stdout);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,126 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief Micro-benchmark of the segment/ray intersection used by castRay.
+ * @details Casts the same random rays against the same random segments
+ * with the trigonometric test that Line::intersection used to do, with
+ * Line::intersection and with sfu::intersectSegmentRay, and prints the time
+ * per intersection and the number of hits of each one. It also times the
+ * closest hit search of sfu::castRay against the one of the EdgeBuffer.
+ */
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "Candle/EdgeBuffer.hpp"
+#include "Candle/geometry/Line.hpp"
+#include "Candle/geometry/Vector2.hpp"
+
+namespace{
+    // Line::intersection before the cross product version
+    bool legacyIntersection(const sfu::Line& seg, const sfu::Line& ray, float& t1, float& t2){
+        auto& a = seg.m_origin;
+        auto& v = seg.m_direction;
+        auto& b = ray.m_origin;
+        auto& w = ray.m_direction;
+
+        float th = sfu::angle(v, w);
+        if(th < 0.001f || th > 359.99f){
+            return false;
+        }
+        if(std::abs(w.y) < 0.001f){
+            t1 = (b.y-a.y) / v.y;
+            t2 = (a.x + t1*v.x - b.x) / w.x;
+        }else{
+            t1 = (w.y * (b.x-a.x) + w.x * (a.y-b.y)) / (v.x*w.y - v.y*w.x);
+            t2 = (t1*v.y + a.y - b.y) / w.y;
+        }
+        return true;
+    }
+
+    struct Result{
+        double ns;
+        unsigned long hits;
+    };
+
+    template <typename Kernel>
+    Result run(const std::vector<sfu::Line>& segments, const std::vector<sfu::Line>& rays, const Kernel& kernel){
+        unsigned long hits = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for(auto& r: rays){
+            for(auto& s: segments){
+                hits += kernel(s, r);
+            }
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+        return {ns / (segments.size() * rays.size()), hits};
+    }
+
+    // Same as run, for kernels that test all the segments at once
+    template <typename Kernel>
+    Result runRays(const std::vector<sfu::Line>& segments, const std::vector<sfu::Line>& rays, const Kernel& kernel){
+        unsigned long hits = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for(auto& r: rays){
+            hits += kernel(r);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+        return {ns / (segments.size() * rays.size()), hits};
+    }
+}
+
+int main(){
+    const int SEGMENTS = 2000;
+    const int RAYS = 2000;
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<float> pos(0.f, 1000.f);
+    std::uniform_real_distribution<float> len(-40.f, 40.f);
+    std::uniform_real_distribution<float> ang(0.f, 360.f);
+
+    std::vector<sfu::Line> segments;
+    for(int i = 0; i < SEGMENTS; i++){
+        sf::Vector2f p(pos(gen), pos(gen));
+        segments.emplace_back(p, p + sf::Vector2f(len(gen), len(gen)));
+    }
+    std::vector<sfu::Line> rays;
+    for(int i = 0; i < RAYS; i++){
+        rays.emplace_back(sf::Vector2f(pos(gen), pos(gen)), ang(gen));
+    }
+
+    Result legacy = run(segments, rays, [](const sfu::Line& s, const sfu::Line& r){
+        float ts, tr;
+        return legacyIntersection(s, r, ts, tr) && tr >= 0.f && ts >= 0.f && ts <= 1.f;
+    });
+    Result line = run(segments, rays, [](const sfu::Line& s, const sfu::Line& r){
+        float ts, tr;
+        return s.intersection(r, ts, tr) == sfu::Line::SECANT && tr >= 0.f && ts >= 0.f && ts <= 1.f;
+    });
+    Result kernel = run(segments, rays, [](const sfu::Line& s, const sfu::Line& r){
+        float tr;
+        return sfu::intersectSegmentRay(s, r, tr);
+    });
+
+    // Closest hit of each ray, so the hits are the rays that hit something
+    candle::EdgeBuffer buffer(segments.begin(), segments.end());
+    const float inf = std::numeric_limits<float>::infinity();
+    Result castVector = runRays(segments, rays, [&](const sfu::Line& r){
+        return std::isfinite(sfu::castRay(segments.begin(), segments.end(), r).x);
+    });
+    Result castBuffer = runRays(segments, rays, [&](const sfu::Line& r){
+        return candle::castRayDistance(buffer, r, inf) != inf;
+    });
+
+    std::printf("%-22s %10s %10s\n", "kernel", "ns/test", "hits");
+    std::printf("%-22s %10.3f %10lu\n", "legacy (acos)", legacy.ns, legacy.hits);
+    std::printf("%-22s %10.3f %10lu\n", "Line::intersection", line.ns, line.hits);
+    std::printf("%-22s %10.3f %10lu\n", "intersectSegmentRay", kernel.ns, kernel.hits);
+    std::printf("%-22s %10.3f %10lu\n", "castRay (EdgeVector)", castVector.ns, castVector.hits);
+    std::printf("%-22s %10.3f %10lu\n", "castRay (EdgeBuffer)", castBuffer.ns, castBuffer.hits);
+    return 0;
+}
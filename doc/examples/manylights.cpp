@@ -0,0 +1,70 @@
+#include <cstdlib>
+#include <memory>
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include "Candle/RadialLight.hpp"
+#include "Candle/LightingArea.hpp"
+#include "Candle/LightBatch.hpp"
+#include "Candle/ThreadPool.hpp"
+
+int main(){
+    // create window
+    sf::RenderWindow w(sf::VideoMode(800, 600), "app");
+
+    // create a lot of light sources
+    std::vector<std::unique_ptr<candle::RadialLight>> lights;
+    for(int i = 0; i < 500; i++){
+        candle::RadialLight* light = new candle::RadialLight;
+        light->setRange(40);
+        light->setColor(sf::Color(std::rand() % 256, std::rand() % 256, 255));
+        light->setPosition(std::rand() % 800, std::rand() % 600);
+        lights.emplace_back(light);
+    }
+
+    // create an edge pool
+    candle::EdgeVector edges;
+    for(int i = 0; i < 20; i++){
+        sf::Vector2f p(std::rand() % 800, std::rand() % 600);
+        edges.emplace_back(p, p + sf::Vector2f(30.f, 30.f));
+    }
+
+    // create the threads once, and the objects to draw the lights
+    candle::ThreadPool pool;
+    candle::LightBatch batch;
+    candle::LightingArea fog(candle::LightingArea::FOG,
+                             sf::Vector2f(0.f, 0.f),
+                             sf::Vector2f(800.f, 600.f));
+    fog.setAreaColor(sf::Color::Black);
+
+    // main loop
+    while(w.isOpen()){
+        sf::Event e;
+        while(w.pollEvent(e)){
+            if(e.type == sf::Event::Closed){
+                w.close();
+            }
+        }
+
+        // move the lights and cast all of them in parallel
+        for(auto& light: lights){
+            light->move(std::rand() % 3 - 1, std::rand() % 3 - 1);
+        }
+        candle::castLights(lights, edges.begin(), edges.end(), pool);
+
+        // copy them to the batch, to draw them with one draw call
+        batch.clear();
+        for(auto& light: lights){
+            batch.add(*light);
+        }
+
+        fog.clear();
+        fog.draw(batch);
+        fog.display();
+
+        w.clear();
+        w.draw(fog);
+        w.draw(batch);
+        w.display();
+    }
+    return 0;
+}
@@ -8,8 +8,23 @@
 #define __CANDLE_LIB_HPP__
 
 #include "Candle/LightSource.hpp"
+#include "Candle/VertexSink.hpp"
+#include "Candle/EdgeIndex.hpp"
+#include "Candle/EdgeBuffer.hpp"
+#include "Candle/EdgeMesh.hpp"
+#include "Candle/EdgeOptimization.hpp"
+#include "Candle/Occluder.hpp"
+#include "Candle/CastScratch.hpp"
+#include "Candle/ThreadPool.hpp"
+#include "Candle/CastPipeline.hpp"
+#include "Candle/Stats.hpp"
+#include "Candle/Visibility.hpp"
 #include "Candle/RadialLight.hpp"
 #include "Candle/DirectedLight.hpp"
+#include "Candle/LightBatch.hpp"
 #include "Candle/LightingArea.hpp"
+#include "Candle/TiledLightingArea.hpp"
+#include "Candle/SoftwareLightingArea.hpp"
+#include "Candle/VisibilityGrid.hpp"
 
 #endif
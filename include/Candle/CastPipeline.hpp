@@ -0,0 +1,242 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the CastJob and CastPipeline classes.
+ */
+#ifndef __CANDLE_CAST_PIPELINE_HPP__
+#define __CANDLE_CAST_PIPELINE_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Candle/LightSource.hpp"
+#include "Candle/ThreadPool.hpp"
+
+namespace candle{
+    class CastPipeline;
+
+    /**
+     * @brief Handle to the casts of a set of lights, that run in the
+     * background.
+     * @details
+     *
+     * A job has one task for each light of its @ref CastPipeline. If the
+     * pipeline has a @ref ThreadPool, the tasks are run in it as soon as the
+     * job is created. If not, they are left to the job system of the
+     * application, that must call @ref run once with each number from 0 to
+     * @ref getTaskCount - 1, from any threads.
+     *
+     * A job is done when all of its tasks have finished.
+     * @see CastPipeline::castLights
+     */
+    class CastJob{
+    private:
+        std::function<void(unsigned int)> m_task;
+        unsigned int m_count;
+        std::atomic<unsigned int> m_remaining;
+        std::mutex m_mutex;
+        std::condition_variable m_done;
+
+        void start(unsigned int count, const std::function<void(unsigned int)>& task);
+
+        friend class CastPipeline;
+
+    public:
+        /**
+         * @brief Constructor.
+         * @details Constructs a job without tasks, that is done.
+         */
+        CastJob();
+
+        CastJob(const CastJob&) = delete;
+        CastJob& operator=(const CastJob&) = delete;
+
+        /**
+         * @brief Get the number of tasks of the job.
+         * @returns The number of lights to cast.
+         */
+        unsigned int getTaskCount() const;
+
+        /**
+         * @brief Run one of the tasks of the job.
+         * @details Casts one light. Different tasks can run at the same time
+         * in different threads, but each one must be run only once.
+         * @param i Number of the task, less than @ref getTaskCount.
+         */
+        void run(unsigned int i);
+
+        /**
+         * @brief Tell if all the tasks have finished.
+         * @returns True if the job is done.
+         */
+        bool isDone() const;
+
+        /**
+         * @brief Wait until all the tasks have finished.
+         * @details Must not be called from the tasks of the job.
+         */
+        void wait();
+    };
+
+    /**
+     * @brief Set of double buffered lights that are casted while the last
+     * casts are drawn.
+     * @details
+     *
+     * Casting the lights right before drawing them makes the frame wait for
+     * the casts. A CastPipeline makes its lights double buffered (see
+     * @ref LightSource::setDoubleBuffered), so they can be casted in other
+     * threads while the ones of the last frame are drawn. A frame goes like
+     * this:
+     *
+     * @code
+     * pipeline.swapBuffers(); // wait for the casts of the last frame
+     * // ... move the lights, update the edges ...
+     * pipeline.castLights(edges); // start the casts of the next frame
+     * // ... draw the lights, that show the casts of the last frame ...
+     * @endcode
+     *
+     * While a job runs, the lights can be drawn, but not modified, and the
+     * edges must not be modified. Everything else waits for the job first:
+     * @ref swapBuffers, the functions that change the set of lights and the
+     * next castLights.
+     *
+     * Without a @ref ThreadPool, the tasks of each @ref CastJob are run by
+     * the application, like in its own job system. With one, they are run
+     * in it from a thread of the pipeline, so the pool must not be used
+     * elsewhere while a job runs.
+     */
+    class CastPipeline{
+    private:
+        ThreadPool* m_pool;
+        std::vector<LightSource*> m_lights;
+        CastJob m_job;
+        std::thread m_thread;
+        std::mutex m_mutex;
+        std::condition_variable m_start;
+        bool m_pending;
+        bool m_stop;
+
+        void loop();
+        CastJob& start(const std::function<void(unsigned int)>& task);
+
+    public:
+        /**
+         * @brief Constructor.
+         * @param pool Threads to run the jobs, or nullptr to run them from
+         * the job system of the application. It must outlive the pipeline.
+         */
+        explicit CastPipeline(ThreadPool* pool = nullptr);
+
+        /**
+         * @brief Destructor.
+         * @details Waits for the current job.
+         */
+        ~CastPipeline();
+
+        CastPipeline(const CastPipeline&) = delete;
+        CastPipeline& operator=(const CastPipeline&) = delete;
+
+        /**
+         * @brief Add a light to the pipeline.
+         * @details The light is made double buffered, and it is the task
+         * with the next number in the jobs.
+         * @param light Light to add. It must outlive the pipeline, or be
+         * removed before.
+         */
+        void addLight(LightSource* light);
+
+        /**
+         * @brief Remove a light from the pipeline.
+         * @details The light stays double buffered. Nothing happens if it is
+         * not in the pipeline.
+         * @param light Light to remove.
+         */
+        void removeLight(LightSource* light);
+
+        /**
+         * @brief Remove all the lights from the pipeline.
+         */
+        void clear();
+
+        /**
+         * @brief Get the lights of the pipeline.
+         * @returns The lights, in the order of the tasks.
+         */
+        const std::vector<LightSource*>& getLights() const;
+
+        /**
+         * @brief Start casting all the lights.
+         * @details Calls @ref LightSource::castLight on every light.
+         * @param begin Iterator to the first sfu::Line of the vector to take
+         * into account.
+         * @param end Iterator to the first sfu::Line of the vector not to be
+         * taken into account.
+         * @returns The job of the casts.
+         */
+        CastJob& castLights(const EdgeVector::iterator& begin, const EdgeVector::iterator& end);
+
+        /**
+         * @brief Start casting all the lights.
+         * @details Same as the version with iterators, with the edges of an
+         * @ref EdgeIndex, an @ref EdgeBuffer or an @ref EdgeMesh.
+         * @param edges Edges to take into account. They must outlive the
+         * job.
+         * @returns The job of the casts.
+         */
+        template <typename Edges>
+        CastJob& castLights(const Edges& edges){
+            return start([this, &edges](unsigned int i){
+                m_lights[i]->castLight(edges);
+            });
+        }
+
+        /**
+         * @brief Start casting the lights that need it.
+         * @details Calls @ref LightSource::castLightIfNeeded on every light.
+         * @param begin Iterator to the first sfu::Line of the vector to take
+         * into account.
+         * @param end Iterator to the first sfu::Line of the vector not to be
+         * taken into account.
+         * @param edgeVersion Version of the edges in the range.
+         * @returns The job of the casts.
+         */
+        CastJob& castLightsIfNeeded(const EdgeVector::iterator& begin, const EdgeVector::iterator& end, unsigned long edgeVersion);
+
+        /**
+         * @brief Start casting the lights that need it.
+         * @details Same as the version with iterators, with the edges of an
+         * @ref EdgeIndex, an @ref EdgeBuffer or an @ref EdgeMesh.
+         * @param edges Edges to take into account. They must outlive the
+         * job.
+         * @returns The job of the casts.
+         */
+        template <typename Edges>
+        CastJob& castLightsIfNeeded(const Edges& edges){
+            return start([this, &edges](unsigned int i){
+                m_lights[i]->castLightIfNeeded(edges);
+            });
+        }
+
+        /**
+         * @brief Get the current job.
+         * @returns The job of the last castLights, or one without tasks.
+         */
+        CastJob& getJob();
+
+        /**
+         * @brief Draw the last casts of the lights from now on.
+         * @details Waits for the current job, and then calls
+         * @ref LightSource::swapBuffers on every light.
+         * @returns The number of lights whose drawn polygon changed.
+         */
+        unsigned int swapBuffers();
+    };
+}
+
+#endif
@@ -0,0 +1,108 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the CastScratch class.
+ */
+#ifndef __CANDLE_CAST_SCRATCH_HPP__
+#define __CANDLE_CAST_SCRATCH_HPP__
+
+#include <cstddef>
+#include <vector>
+
+#include "SFML/System/Vector2.hpp"
+
+#include "Candle/EdgeIndex.hpp"
+
+namespace candle{
+    /**
+     * @brief Reusable buffers for the computations of castLight.
+     * @details
+     *
+     * Casting a light needs some temporary storage, like the list of rays
+     * and their hit points. Instead of allocating it in every cast, the
+     * lights use the buffers of a CastScratch, that keep their capacity
+     * between casts. After a few frames the buffers are big enough for every
+     * light, and casting does not allocate memory anymore.
+     *
+     * By default, each thread has its own scratch, shared by all the lights
+     * casted from it (see @ref getThreadScratch). A light can be given a
+     * different one with @ref LightSource::setCastScratch. A scratch can be
+     * shared by many lights, but not used by two threads at the same time.
+     * @ref visibleSet also keeps the edges it filters in the scratch of its
+     * thread.
+     *
+     * The SWEEP algorithm of @ref RadialLight still allocates the ordered set
+     * of the edges it crosses.
+     */
+    class CastScratch{
+    private:
+        static const unsigned int BUFFERS = 13;
+
+        // Arc of directions, relative to the start of the beam of a light
+        struct AngleRange{
+            float start;
+            float width;
+        };
+
+        std::vector<unsigned int> m_ids;
+        std::vector<float> m_angles;
+        std::vector<sf::Vector2f> m_directions;
+        std::vector<unsigned int> m_order;
+        std::vector<float> m_hitAngles;
+        std::vector<sf::Vector2f> m_points;
+        std::vector<float> m_mergedAngles;
+        std::vector<sf::Vector2f> m_merged;
+        std::vector<float> m_params;
+        std::vector<EdgeChange> m_changes;
+        std::vector<AngleRange> m_window;
+        std::vector<sfu::Line> m_edges;
+        std::vector<unsigned int> m_occluders;
+#ifdef CANDLE_DEBUG
+        std::size_t m_capacities[BUFFERS];
+        unsigned long m_allocations;
+#endif
+
+        void getCapacities(std::size_t* capacities) const;
+        void beginCast();
+        void endCast();
+
+        friend class LightSource;
+        friend class RadialLight;
+        friend class DirectedLight;
+        friend void visibleSet(const sf::Vector2f& from, const std::vector<sf::Vector2f>& points, const EdgeVector::iterator& begin, const EdgeVector::iterator& end, std::vector<unsigned int>& visible);
+
+    public:
+        /**
+         * @brief Constructor.
+         * @details Constructs a scratch with empty buffers.
+         */
+        CastScratch();
+
+        /**
+         * @brief Free the memory of the buffers.
+         * @details The next casts will allocate it again.
+         */
+        void release();
+
+        /**
+         * @brief Get the number of times that a buffer had to grow.
+         * @details Only counted if `CANDLE_DEBUG` is defined, otherwise it is
+         * always 0. Once the buffers are big enough, it should stop growing,
+         * so it can be used to check that a frame does no allocations.
+         * @returns The number of times that a buffer grew during a cast.
+         */
+        unsigned long getAllocationCount() const;
+
+        /**
+         * @brief Get the scratch of the calling thread.
+         * @details It is used by the lights without a scratch of their own,
+         * and destroyed when the thread exits.
+         * @returns The scratch of the calling thread.
+         * @see LightSource::setCastScratch
+         */
+        static CastScratch& getThreadScratch();
+    };
+}
+
+#endif
@@ -12,6 +12,12 @@ namespace sfu{
      * PI constant.
      */
     extern const float PI;
+
+    /**
+     * Sine of the smallest angle between two lines for them not to be
+     * considered parallel (0.001 degrees).
+     */
+    extern const float PARALLEL_EPSILON;
 }
 
 #endif
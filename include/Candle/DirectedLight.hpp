@@ -32,14 +32,31 @@ namespace candle{
     class DirectedLight: public LightSource{
     private:
         float m_beamWidth;
+        std::vector<float> m_rayLengths; // length of each ray in the polygon
         
         void draw(sf::RenderTarget& t, sf::RenderStates st) const override;
         void resetColor() override;
+        void setQuadColor(sf::VertexArray& polygon, unsigned int i) const;
+        bool castLightChanges(const EdgeIndex& index, const std::vector<EdgeChange>& changes) override;
+        sf::FloatRect getBeamBounds() const;
+        std::size_t countTriangleVertices(const sf::VertexArray& polygon) const override;
+        void writeTriangles(const sf::VertexArray& polygon, const sf::Transform& transform, sf::Vertex* triangles) const override;
+        
+        template <typename EdgeVisitor, typename RayCaster>
+        void castLightImpl(const EdgeVisitor& forEachEdge, const RayCaster& caster);
+        template <typename Iterator>
+        void castLightRange(const Iterator& begin, const Iterator& end);
     public:
         DirectedLight();
         
         void castLight(const EdgeVector::iterator& begin, const EdgeVector::iterator& end) override;
         
+        void castLight(const EdgeIndex& index) override;
+        
+        void castLight(const EdgeBuffer& edges) override;
+        
+        void castLight(const EdgeMesh& mesh) override;
+        
         /**
          * @brief Set the width of the beam.
          * @details The width specifies the maximum distance allowed from the 
@@ -57,6 +74,16 @@ namespace candle{
          */
         float getBeamWidth() const;
         
+        /**
+         * @brief Get the global bounding rectangle of the light.
+         * @details It is the bounding rectangle of the polygon of the last
+         * cast.
+         * @returns The global bounding rectangle in float.
+         */
+        sf::FloatRect getGlobalBounds() const override;
+        
+        float getIntensityAt(const sf::Vector2f& point, sf::Vector2f& source) const override;
+        
     };
 }
 
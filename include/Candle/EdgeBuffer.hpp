@@ -0,0 +1,136 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the EdgeBuffer class and the functions to cast
+ * rays against it.
+ */
+#ifndef __CANDLE_EDGE_BUFFER_HPP__
+#define __CANDLE_EDGE_BUFFER_HPP__
+
+#include <vector>
+#include <limits>
+
+#include "Candle/LightSource.hpp"
+#include "Candle/geometry/Line.hpp"
+
+namespace candle{
+    /**
+     * @brief Edge pool stored as a structure of arrays.
+     * @details
+     *
+     * An EdgeBuffer keeps a copy of a set of edges with the coordinates of
+     * their origins and directions in four separate arrays, so a ray can be
+     * tested against several contiguous edges with a single SIMD instruction.
+     *
+     * The instruction set is chosen at compile time: AVX (8 edges at a time)
+     * if the compiler targets it, otherwise SSE2 or NEON on AArch64 (4 edges at
+     * a time), and plain scalar code in any other case. Defining the macro
+     * `CANDLE_NO_SIMD` forces the scalar code. All of them give the same
+     * results as @ref sfu::intersectSegmentRay.
+     *
+     * It is meant for big edge pools where most of the edges are in range of
+     * the lights, and can be passed to @ref LightSource::castLight instead of
+     * a range of iterators. If the edges change, the buffer must be built
+     * again, which also changes its version.
+     * @see castRay(const EdgeBuffer&, const sfu::Line&, float), castRays
+     */
+    class EdgeBuffer{
+    private:
+        std::vector<float> m_x;
+        std::vector<float> m_y;
+        std::vector<float> m_dx;
+        std::vector<float> m_dy;
+        unsigned int m_size;
+        unsigned long m_version;
+
+        friend float castRayDistance(const EdgeBuffer& edges, const sfu::Line& ray, float maxRange);
+
+    public:
+        /**
+         * @brief Constructor.
+         * @details Constructs an empty buffer.
+         */
+        EdgeBuffer();
+
+        /**
+         * @brief Constructor.
+         * @details Constructs a buffer with the edges in the range.
+         * @param begin Iterator to the first sfu::Line to copy.
+         * @param end Iterator to the first sfu::Line not to be copied.
+         * @see build
+         */
+        EdgeBuffer(const EdgeVector::iterator& begin, const EdgeVector::iterator& end);
+
+        /**
+         * @brief Fill the buffer with a range of edges.
+         * @details The edges are copied, so the range may be modified or
+         * destroyed after the call without affecting the buffer. Any edge
+         * previously in the buffer is discarded.
+         * @param begin Iterator to the first sfu::Line to copy.
+         * @param end Iterator to the first sfu::Line not to be copied.
+         */
+        void build(const EdgeVector::iterator& begin, const EdgeVector::iterator& end);
+
+        /**
+         * @brief Get the number of edges in the buffer.
+         * @returns The number of edges in the buffer.
+         */
+        unsigned int size() const;
+
+        /**
+         * @brief Get an edge of the buffer.
+         * @param i Position of the edge, from 0 to size() - 1.
+         * @returns The edge in the position @p i.
+         */
+        sfu::Line getEdge(unsigned int i) const;
+
+        /**
+         * @brief Get the version of the edges.
+         * @details The buffer takes a new version from
+         * @ref newEdgeVersion every time it is built.
+         * @returns The version of the edges.
+         * @see LightSource::castLightIfNeeded
+         */
+        unsigned long getVersion() const;
+    };
+
+    /**
+     * @brief Cast a ray against the edges of a buffer.
+     * @details Same as @ref sfu::castRay, but testing several edges at a
+     * time.
+     * @param edges Buffer of edges to test.
+     * @param ray Ray casted from its origin in its direction.
+     * @param maxRange Max distance allowed for the ray to hit a segment.
+     * @returns The distance from the origin of the ray to the closest hit
+     * point, or @p maxRange if there is none.
+     */
+    float castRayDistance(const EdgeBuffer& edges, const sfu::Line& ray, float maxRange);
+
+    /**
+     * @brief Cast a ray against the edges of a buffer.
+     * @details Same as @ref sfu::castRay, but testing several edges at a
+     * time.
+     * @param edges Buffer of edges to test.
+     * @param ray Ray casted from its origin in its direction.
+     * @param maxRange Optional argument to indicate the max distance
+     * allowed for the ray to hit a segment.
+     * @returns The closest hit point, or the point of the ray at
+     * @p maxRange if there is none.
+     */
+    sf::Vector2f castRay(const EdgeBuffer& edges, const sfu::Line& ray, float maxRange = std::numeric_limits<float>::infinity());
+
+    /**
+     * @brief Cast a set of rays against the edges of a buffer.
+     * @param edges Buffer of edges to test.
+     * @param rays Rays casted from their origin in their direction.
+     * @param out (Output argument) Closest hit point of each ray, or its point
+     * at @p maxRange if there is none, in the same order as @p rays. The
+     * previous content is discarded.
+     * @param maxRange Optional argument to indicate the max distance allowed
+     * for a ray to hit a segment.
+     */
+    void castRays(const EdgeBuffer& edges, const std::vector<sfu::Line>& rays, std::vector<sf::Vector2f>& out, float maxRange = std::numeric_limits<float>::infinity());
+}
+
+#endif
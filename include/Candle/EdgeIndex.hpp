@@ -0,0 +1,214 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the EdgeIndex class.
+ */
+#ifndef __CANDLE_EDGE_INDEX_HPP__
+#define __CANDLE_EDGE_INDEX_HPP__
+
+#include <vector>
+#include <deque>
+#include <limits>
+#include <functional>
+
+#include "SFML/Graphics/Rect.hpp"
+
+#include "Candle/LightSource.hpp"
+#include "Candle/geometry/Line.hpp"
+
+namespace candle{
+    /**
+     * @brief Modification of an edge of an @ref EdgeIndex.
+     * @see EdgeIndex::update, EdgeIndex::getChanges
+     */
+    struct EdgeChange{
+        unsigned int id; ///< Identifier of the edge.
+        sfu::Line before; ///< Edge before the change.
+        sfu::Line after; ///< Edge after the change.
+        unsigned long version; ///< Version of the index after the change.
+    };
+
+    /**
+     * @brief Spatial index over an edge pool.
+     * @details
+     *
+     * An EdgeIndex keeps a copy of a set of edges distributed in a uniform
+     * grid of square cells. Each cell stores the edges whose segment crosses
+     * it, so a ray only has to be tested against the edges of the cells it
+     * traverses, and the traversal stops as soon as the closest hit is
+     * known.
+     *
+     * It is meant to be built once from an @ref EdgeVector when the edges are
+     * static, and passed to @ref LightSource::castLight instead of a range
+     * of iterators. If a few edges change, like a door that opens, they can
+     * be modified one by one with @ref update. The index remembers the last
+     * changes, so @ref LightSource::castLightIfNeeded only casts again the
+     * lights that may see them.
+     *
+     * The size of the cells should be in the order of the length of the
+     * edges. Too small cells make the edges to be stored repeatedly and the
+     * rays to traverse too many empty cells; too big cells make the rays test
+     * edges that are not in their way.
+     */
+    class EdgeIndex{
+    private:
+        EdgeVector m_edges;
+        std::vector<std::vector<unsigned int>> m_cells;
+        sf::Vector2f m_gridOrigin;
+        float m_cellSize;
+        int m_cols;
+        int m_rows;
+        unsigned long m_version;
+        unsigned long m_baseVersion; // version before the first change kept
+        std::deque<EdgeChange> m_changes;
+        std::function<void(const EdgeChange&)> m_changeCallback;
+
+        int cellX(float x) const;
+        int cellY(float y) const;
+        template <typename CellVisitor>
+        void forEachCell(const sfu::Line& edge, const CellVisitor& f);
+        void insert(unsigned int id);
+        void erase(unsigned int id);
+        void buildGrid();
+
+    public:
+        /**
+         * @brief Constructor.
+         * @details Constructs an empty index.
+         * @param cellSize Side of the grid cells.
+         */
+        explicit EdgeIndex(float cellSize = 64.f);
+
+        /**
+         * @brief Constructor.
+         * @details Constructs an index with the edges in the range.
+         * @param begin Iterator to the first sfu::Line to index.
+         * @param end Iterator to the first sfu::Line not to be indexed.
+         * @param cellSize Side of the grid cells.
+         * @see build
+         */
+        EdgeIndex(const EdgeVector::iterator& begin, const EdgeVector::iterator& end, float cellSize = 64.f);
+
+        /**
+         * @brief Build the index from a range of edges.
+         * @details The edges are copied, so the range may be modified or
+         * destroyed after the call without affecting the index. Any edge
+         * previously indexed is discarded.
+         * @param begin Iterator to the first sfu::Line to index.
+         * @param end Iterator to the first sfu::Line not to be indexed.
+         */
+        void build(const EdgeVector::iterator& begin, const EdgeVector::iterator& end);
+
+        /**
+         * @brief Modify an indexed edge.
+         * @details Only the cells crossed by the old and the new edge are
+         * updated, unless the new edge goes out of the grid, in which case
+         * the grid is built again. The index takes a new version, and the
+         * change is passed to the change callback, if any.
+         * @param id Identifier of the edge, its position in @ref getEdges.
+         * @param edge New value of the edge.
+         * @see getChanges, setChangeCallback
+         */
+        void update(unsigned int id, const sfu::Line& edge);
+
+        /**
+         * @brief Get the changes made after a version of the index.
+         * @details Only the last changes are kept, and building the index
+         * discards all of them, so the changes made after old versions may
+         * not be available.
+         * @param version A version returned by @ref getVersion.
+         * @param changes (Output argument) Changes made after @p version, in
+         * the same order they were made. The previous content is discarded.
+         * @returns False if @p version is not a version of this index or the
+         * changes made after it are no longer available.
+         * @see update
+         */
+        bool getChanges(unsigned long version, std::vector<EdgeChange>& changes) const;
+
+        /**
+         * @brief Set a function to call every time an edge is modified.
+         * @details The function is called by @ref update, after the change.
+         * An empty function removes the callback.
+         * @param callback Function to call with each change.
+         */
+        void setChangeCallback(const std::function<void(const EdgeChange&)>& callback);
+
+        /**
+         * @brief Set the side of the grid cells.
+         * @details The index is rebuilt with the new size.
+         * @param cellSize Side of the grid cells. Must be greater than 0.
+         * @see getCellSize
+         */
+        void setCellSize(float cellSize);
+
+        /**
+         * @brief Get the side of the grid cells.
+         * @returns The side of the grid cells.
+         * @see setCellSize
+         */
+        float getCellSize() const;
+
+        /**
+         * @brief Get the version of the indexed edges.
+         * @details The index takes a new version from
+         * @ref newEdgeVersion every time it is built or an edge is updated.
+         * @returns The version of the indexed edges.
+         * @see LightSource::castLightIfNeeded
+         */
+        unsigned long getVersion() const;
+
+        /**
+         * @brief Get the indexed edges.
+         * @details The identifier of an edge is its position in this vector.
+         * @returns The indexed edges.
+         */
+        const EdgeVector& getEdges() const;
+
+        /**
+         * @brief Get the rectangle covered by the grid.
+         * @returns The rectangle covered by the grid in global coordinates.
+         */
+        sf::FloatRect getBounds() const;
+
+        /**
+         * @brief Get the identifiers of the edges that may be within a
+         * rectangle.
+         * @details The result contains every edge that crosses the grid cells
+         * overlapped by @p rect, in increasing order and without repetitions.
+         * It is a superset of the edges that actually intersect @p rect.
+         * @param rect Rectangle in global coordinates.
+         * @param ids (Output argument) Identifiers of the edges found. The
+         * previous content is discarded.
+         * @see getEdges
+         */
+        void query(const sf::FloatRect& rect, std::vector<unsigned int>& ids) const;
+
+        /**
+         * @brief Cast a ray against the indexed edges.
+         * @details Equivalent to @ref sfu::castRay, but only the edges in the
+         * cells crossed by the ray are tested, and the cells are walked in
+         * order until the closest hit is found or @p maxRange is reached.
+         * @param ray Ray casted from its origin in its direction.
+         * @param maxRange Max distance allowed for the ray to hit a segment.
+         * @param t (Output argument) If there is a hit, the distance from the
+         * origin of the ray to the hit point.
+         * @returns True if the ray hits an edge within @p maxRange.
+         */
+        bool castRay(const sfu::Line& ray, float maxRange, float& t) const;
+
+        /**
+         * @brief Cast a ray against the indexed edges.
+         * @details Equivalent to @ref sfu::castRay, but only the edges in the
+         * cells crossed by the ray are tested.
+         * @param ray Ray casted from its origin in its direction.
+         * @param maxRange Optional argument to indicate the max distance
+         * allowed for a ray to hit a segment.
+         * @returns The closest hit point, or the point of the ray at
+         * @p maxRange if there is none.
+         */
+        sf::Vector2f castRay(const sfu::Line& ray, float maxRange = std::numeric_limits<float>::infinity()) const;
+    };
+}
+
+#endif
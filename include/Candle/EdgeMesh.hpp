@@ -0,0 +1,170 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the EdgeMesh class.
+ */
+#ifndef __CANDLE_EDGE_MESH_HPP__
+#define __CANDLE_EDGE_MESH_HPP__
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "SFML/System/Vector2.hpp"
+
+#include "Candle/LightSource.hpp"
+#include "Candle/geometry/Polygon.hpp"
+
+namespace candle{
+    /**
+     * @brief Edge pool with the vertices shared between the edges.
+     * @details
+     *
+     * A @ref RadialLight casts rays to both ends of every edge in range, and
+     * just past them on both sides. In a closed polygon each corner is the
+     * end of two edges, so it gets those rays twice. An EdgeMesh stores each
+     * vertex once, with the segments that join them, so the light casts the
+     * rays to each vertex once, and only past it on the sides where no
+     * segment of the vertex blocks them.
+     *
+     * The segments added with a polygon know which side is solid, so the
+     * vertices whose segments all face away from the light, that are hidden
+     * by the polygon itself, get no rays at all. For this, the light must
+     * be out of the polygons.
+     *
+     * The ends closer than the tolerance of the mesh are welded into one
+     * vertex as they are added. If the mesh changes, its version changes
+     * too.
+     * @see LightSource::castLight(const EdgeMesh&)
+     */
+    class EdgeMesh{
+    public:
+        /**
+         * @brief Segment joining two vertices of the mesh.
+         */
+        struct Segment{
+            unsigned int a; ///< Index of the first vertex.
+            unsigned int b; ///< Index of the second vertex.
+            /**
+             * 1 if the solid side is the one of the points p with a positive
+             * cross product (b - a) x (p - a), -1 if it is the other one, and
+             * 0 if the segment is a wall with two sides.
+             */
+            int solidSide;
+        };
+
+    private:
+        float m_tolerance;
+        std::vector<sf::Vector2f> m_vertices;
+        std::vector<Segment> m_segments;
+        EdgeVector m_edges;
+        std::vector<std::vector<unsigned int>> m_vertexSegments;
+        std::unordered_map<std::uint64_t, std::vector<unsigned int>> m_cells;
+        unsigned long m_version;
+
+        std::uint64_t cellKey(const sf::Vector2f& point, int dx, int dy) const;
+
+    public:
+        /**
+         * @brief Constructor.
+         * @details Constructs an empty mesh.
+         * @param tolerance Maximum distance between two points to weld them
+         * into one vertex. With 0, only equal points are welded.
+         */
+        explicit EdgeMesh(float tolerance = 1e-3f);
+
+        /**
+         * @brief Constructor.
+         * @details Constructs a mesh with the edges in the range, all of
+         * them with two sides.
+         * @param begin Iterator to the first sfu::Line to add.
+         * @param end Iterator to the first sfu::Line not to be added.
+         * @param tolerance Maximum distance between two points to weld them
+         * into one vertex.
+         * @see addEdges
+         */
+        EdgeMesh(const EdgeVector::iterator& begin, const EdgeVector::iterator& end, float tolerance = 1e-3f);
+
+        /**
+         * @brief Remove all the vertices and segments.
+         */
+        void clear();
+
+        /**
+         * @brief Add a vertex, or find the one it is welded to.
+         * @param point Position of the vertex.
+         * @returns The index of the vertex within the tolerance of
+         * @p point, or of a new one if there is none.
+         */
+        unsigned int addVertex(const sf::Vector2f& point);
+
+        /**
+         * @brief Add a segment between two vertices.
+         * @details Segments between a vertex and itself are ignored.
+         * @param a Index of the first vertex.
+         * @param b Index of the second vertex.
+         * @param solidSide Solid side of the segment, as in Segment::solidSide.
+         */
+        void addSegment(unsigned int a, unsigned int b, int solidSide = 0);
+
+        /**
+         * @brief Add an edge, with two sides.
+         * @param edge Edge to add.
+         */
+        void addEdge(const Edge& edge);
+
+        /**
+         * @brief Add a range of edges, with two sides.
+         * @param begin Iterator to the first sfu::Line to add.
+         * @param end Iterator to the first sfu::Line not to be added.
+         */
+        void addEdges(const EdgeVector::iterator& begin, const EdgeVector::iterator& end);
+
+        /**
+         * @brief Add the edges of a closed polygon.
+         * @details Its lines are taken as a loop, where each one begins at
+         * the end of the previous one.
+         * @param polygon Polygon to add.
+         * @param solid True if the inside of the polygon is solid, like an
+         * obstacle, or false to add its edges with two sides.
+         */
+        void addPolygon(const sfu::Polygon& polygon, bool solid = true);
+
+        /**
+         * @brief Get the vertices of the mesh.
+         * @returns The positions of the vertices.
+         */
+        const std::vector<sf::Vector2f>& getVertices() const;
+
+        /**
+         * @brief Get the segments of the mesh.
+         * @returns The segments, in the order they were added.
+         */
+        const std::vector<Segment>& getSegments() const;
+
+        /**
+         * @brief Get the segments of the mesh as edges.
+         * @returns One edge for each segment, in the same order.
+         */
+        const EdgeVector& getEdges() const;
+
+        /**
+         * @brief Get the segments that begin or end at a vertex.
+         * @param vertex Index of the vertex.
+         * @returns The indices of the segments of the vertex.
+         */
+        const std::vector<unsigned int>& getVertexSegments(unsigned int vertex) const;
+
+        /**
+         * @brief Get the version of the edges.
+         * @details The mesh takes a new version from @ref newEdgeVersion
+         * every time it changes.
+         * @returns The version of the edges.
+         * @see LightSource::castLightIfNeeded
+         */
+        unsigned long getVersion() const;
+    };
+}
+
+#endif
@@ -0,0 +1,63 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the function to simplify a set of edges.
+ */
+#ifndef __CANDLE_EDGE_OPTIMIZATION_HPP__
+#define __CANDLE_EDGE_OPTIMIZATION_HPP__
+
+#include <cstddef>
+
+#include "Candle/LightSource.hpp"
+
+namespace candle{
+    /**
+     * @brief Result of @ref optimizeEdges.
+     */
+    struct EdgeOptimizationReport{
+        std::size_t inputEdges; ///< Edges before the optimization.
+        std::size_t outputEdges; ///< Edges after the optimization.
+        std::size_t weldedVertices; ///< Ends of edges moved to a close one.
+        std::size_t degenerateEdges; ///< Edges removed for having no length.
+    };
+
+    /**
+     * @brief Simplify a set of edges without changing the shadows they cast.
+     * @details
+     *
+     * Level geometry built from tiles, like with one sfu::Polygon for each
+     * sf::Rect, has many redundant edges: the walls between adjacent tiles
+     * and the walls along a row of tiles split in one edge per tile. Each of
+     * them costs rays and intersection tests in every cast. This function
+     * removes them in four steps:
+     *
+     * 1. The ends of the edges closer than @p tolerance are welded into
+     * one point.
+     * 2. The edges with both ends welded together are removed.
+     * 3. The edges on the same line are split where any of them begins or
+     * ends. The pieces covered in both directions are taken as the wall
+     * between two filled polygons, like two tiles, and removed, if
+     * @p removeInterior is true. Otherwise, or if they are covered in
+     * the same direction several times, they are kept only once.
+     * 4. The pieces that are left and touch each other are merged.
+     *
+     * The third step relies on the polygons having the same winding, which
+     * is the case for the ones made from rectangles. It should be disabled
+     * if the edges are lone walls, that could be duplicated in opposite
+     * directions.
+     *
+     * The ends of the edges that are left keep their positions, but the
+     * order of the edges changes. It is meant to be run once, when a level
+     * is loaded, before building an @ref EdgeIndex or an @ref EdgeBuffer.
+     * @param edges Edges to simplify, in place.
+     * @param tolerance Maximum distance between the ends to weld, and
+     * between two lines to merge them.
+     * @param removeInterior True to remove the edges shared by two
+     * polygons.
+     * @returns How much the edges were reduced.
+     */
+    EdgeOptimizationReport optimizeEdges(EdgeVector& edges, float tolerance = 1e-3f, bool removeInterior = true);
+}
+
+#endif
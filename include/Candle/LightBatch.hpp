@@ -0,0 +1,76 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the LightBatch class.
+ */
+#ifndef __CANDLE_LIGHT_BATCH_HPP__
+#define __CANDLE_LIGHT_BATCH_HPP__
+
+#include "SFML/Graphics.hpp"
+
+#include "Candle/RadialLight.hpp"
+
+namespace candle{
+    /**
+     * @brief Set of RadialLights drawn together.
+     * @details
+     *
+     * Drawing a light is a separate draw call, so drawing hundreds of them
+     * one by one is slow. All the RadialLights share the same two textures
+     * or shaders (see @ref RadialLight::setFalloff), one for the lights that
+     * fade and one for the ones that don't, so a LightBatch copies the
+     * polygons of many of them, with their transforms already applied, into
+     * one vertex array for each. The whole batch is then drawn with one draw
+     * call, or two if it has lights of both kinds.
+     *
+     * The batch keeps a copy of the polygons, so it has to be cleared and
+     * filled again every time the lights are casted, moved or recolored. It
+     * can be drawn to any target, like any light, or passed to
+     * @ref LightingArea::draw(const LightBatch&).
+     * @see RadialLight
+     */
+    class LightBatch: public sf::Drawable{
+    private:
+        sf::VertexArray m_fadeTriangles;
+        sf::VertexArray m_plainTriangles;
+        unsigned int m_lightCount;
+
+        void draw(sf::RenderTarget& t, sf::RenderStates st) const override;
+
+    public:
+        /**
+         * @brief Constructor.
+         * @details Constructs an empty batch.
+         */
+        LightBatch();
+
+        /**
+         * @brief Remove all the lights from the batch.
+         * @details The memory is kept to be reused by the next lights.
+         */
+        void clear();
+
+        /**
+         * @brief Add a light to the batch.
+         * @details The current polygon, color and transform of the light are
+         * copied, so later changes of the light don't affect the batch.
+         * @param light Light to add.
+         */
+        void add(const RadialLight& light);
+
+        /**
+         * @brief Get the number of lights in the batch.
+         * @returns The number of lights added since the last clear.
+         */
+        unsigned int getLightCount() const;
+
+        /**
+         * @brief Get the number of vertices in the batch.
+         * @returns The number of vertices of the triangles of all the lights.
+         */
+        unsigned int getVertexCount() const;
+    };
+}
+
+#endif
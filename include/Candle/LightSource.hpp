@@ -8,6 +8,7 @@
 #ifndef __CANDLE_LIGHTSOURCE_HPP__
 #define __CANDLE_LIGHTSOURCE_HPP__
 
+#include <memory>
 #include <vector>
 
 #include "SFML/Graphics.hpp"
@@ -27,16 +28,35 @@ namespace candle{
      */
     typedef std::vector<Edge> EdgeVector;
     
+    class EdgeIndex;
+    class EdgeBuffer;
+    class EdgeMesh;
+    struct EdgeChange;
+    class CastScratch;
+    class OccluderList;
+    class VertexSink;
+    
     /**
      * @brief This function initializes the Texture used for the RadialLights.
-     * @details This function is called the first time a RadialLight is created
-     * , so the user shouldn't need to do it. Anyways, it could be 
-     * necessary to do it explicitly if you declare a RadialLight that, for 
-     * some reason, is global or static RadialLight and is not constructed in
-     * a normal order.
+     * @details This function is called the first time a RadialLight is drawn
+     * with the TEXTURE falloff, so the user shouldn't need to do it.
+     * Anyways, it could be necessary to do it explicitly if you declare a
+     * RadialLight that, for some reason, is global or static RadialLight and
+     * is not constructed in a normal order.
      */
     void initializeTextures();
     
+    /**
+     * @brief Get a new edge version.
+     * @details Each call returns a number different from all the previous
+     * ones, from any thread. @ref EdgeIndex and @ref EdgeBuffer take a new
+     * version every time their edges change, and it can be used to tag any
+     * other set of edges, so that @ref LightSource::castLightIfNeeded knows
+     * when to cast the light again.
+     * @returns A new edge version, never 0.
+     */
+    unsigned long newEdgeVersion();
+    
     /**
      * @brief Interface for objects that emit light
      * @details
@@ -54,8 +74,25 @@ namespace candle{
      * By default, they use a sf::BlendAdd mode. This means that you can
      * specify any other blend mode you want, except sf::BlendAlpha, that
      * will be changed to the additive mode.
+     * 
+     * A light of the application only needs to implement draw, resetColor
+     * and the castLight with iterators. The other casts copy the edges and
+     * call that one, unless they are overridden too; to call them on the
+     * subclass, bring them in with `using LightSource::castLight;`.
      */
     class LightSource: public sf::Transformable, public sf::Drawable{
+    public:
+        /**
+         * @brief Ways to keep the vertices of the polygon for drawing.
+         * @see setVertexStorage
+         */
+        enum VertexStorage{
+            /** In a sf::VertexArray, sent to the graphics card in every draw. */
+            VERTEX_ARRAY,
+            /** In a sf::VertexBuffer, sent only when the polygon changes. */
+            VERTEX_BUFFER
+        };
+
     private:
         /**
          * @brief Draw the object to a target
@@ -68,18 +105,177 @@ namespace candle{
         float m_range;
         float m_intensity; // only for fog
         bool m_fade;
+        bool m_castDirty; // a parameter changed, or castLight was called, since castLightIfNeeded
+        mutable bool m_bufferDirty; // the polygon changed since it was uploaded
+        float m_lodTolerance; // details smaller than this are ignored, 0 for none
+        const OccluderList* m_occluders; // not owned, casted along with the edges
 
 #ifdef CANDLE_DEBUG        
         sf::VertexArray m_debug;
 #endif
         
         virtual void resetColor() = 0;
+        
+        /**
+         * @brief Tell if the level of detail drops the extra rays around
+         * the ends of the edges and merges close rays.
+         * @param size Size of the light across, in world units.
+         * @returns True if the light is small compared to its tolerance.
+         * @see setLodTolerance
+         */
+        bool isCoarseLod(float size) const;
+        
+        /**
+         * @brief Update the polygon after some edges of an index changed.
+         * @details Called by @ref castLightIfNeeded when the light is the same
+         * as in the last cast and the index only changed by
+         * @ref EdgeIndex::update. The default implementation casts the light
+         * again with the whole index.
+         * @param index Spatial index of the edges, after the changes.
+         * @param changes Changes made in the index since the last cast.
+         * @returns True if the polygon was modified.
+         */
+        virtual bool castLightChanges(const EdgeIndex& index, const std::vector<EdgeChange>& changes);
+        
+        /**
+         * @brief Get the buffers to use in a cast.
+         * @returns The scratch set with @ref setCastScratch, or the one of
+         * the calling thread.
+         */
+        CastScratch& castScratch();
+        
+        /**
+         * @brief Draw the polygon with the storage of the light.
+         * @details If the storage is VERTEX_BUFFER, the polygon is uploaded
+         * first if it changed since the last time.
+         * @param t Target to draw to.
+         * @param s States to draw with.
+         */
+        void drawPolygon(sf::RenderTarget& t, const sf::RenderStates& s) const;
+        
+        /**
+         * @brief Get the transform from the coordinates of the polygon to
+         * global coordinates.
+         * @details The default implementation returns the transform of the
+         * light.
+         * @returns The transform of the polygon.
+         */
+        virtual sf::Transform getPolygonTransform() const;
+        
+        /**
+         * @brief Get the polygon to draw.
+         * @details It is the one of the last cast, or the one of the last
+         * @ref swapBuffers if the light is double buffered.
+         * @returns The polygon to draw.
+         */
+        const sf::VertexArray& getFrontPolygon() const;
+        
+        /**
+         * @brief Get the transform of the polygon to draw.
+         * @returns The result of @ref getPolygonTransform, as it was in the
+         * last @ref swapBuffers if the light is double buffered.
+         */
+        sf::Transform getFrontTransform() const;
+        
+        /**
+         * @brief Get the polygon of the last cast, drawn or not.
+         * @details It is the one to change when the color changes, and
+         * @ref latestPolygonChanged must be called after.
+         * @returns The newest polygon of the light.
+         */
+        sf::VertexArray& getLatestPolygon();
+        
+        /**
+         * @brief Tell that the colors of @ref getLatestPolygon changed.
+         */
+        void latestPolygonChanged();
+        
+        /**
+         * @brief Get the number of vertices of a polygon of the light split
+         * in triangles.
+         * @details The default implementation returns 0, for lights that
+         * can't be written as triangles, which are then left out.
+         * @param polygon Polygon of the light.
+         * @returns The number of vertices that @ref writeTriangles writes.
+         */
+        virtual std::size_t countTriangleVertices(const sf::VertexArray& polygon) const;
+        
+        /**
+         * @brief Write a polygon of the light as separate triangles.
+         * @details The positions are transformed, and the colors and texture
+         * coordinates are kept. The default implementation writes nothing.
+         * @param polygon Polygon of the light.
+         * @param transform Transform of the polygon to global coordinates.
+         * @param triangles Where to write the result, with space for the
+         * @ref countTriangleVertices vertices.
+         */
+        virtual void writeTriangles(const sf::VertexArray& polygon, const sf::Transform& transform, sf::Vertex* triangles) const;
+        
+        /**
+         * @brief Get the alpha that the texture or shader of the light
+         * applies to a point of the polygon.
+         * @details The default implementation returns 1, for lights that
+         * are drawn with their vertex colors only.
+         * @param texCoords Texture coordinates of the point.
+         * @returns Factor to multiply the alpha of the color by, from 0 to 1.
+         */
+        virtual float getFalloffAt(const sf::Vector2f& texCoords) const;
+        
+        /**
+         * @brief Get the circle of texture coordinates out of which
+         * @ref getFalloffAt is zero.
+         * @details The default implementation returns false, for lights
+         * without such a limit.
+         * @param center Center of the circle.
+         * @param radius Radius of the circle.
+         * @returns True if the light has a circle.
+         */
+        virtual bool getFalloffCircle(sf::Vector2f& center, float& radius) const;
+        
+        friend class SoftwareLightingArea;
+        friend class VisibilityGrid;
+    
+    private:
+        sf::Transform m_castTransform;
+        unsigned long m_castEdgeVersion;
+        unsigned long m_castOccluderVersion;
+        CastScratch* m_scratch;
+        VertexStorage m_storage;
+        // Only created when drawn with VERTEX_BUFFER, since it needs a
+        // context, and never copied
+        mutable std::unique_ptr<sf::VertexBuffer> m_buffer;
+        // With double buffering, m_bufferDirty tells if m_polygon is newer
+        // than m_front, and m_frontDirty if m_front changed since uploaded
+        bool m_doubleBuffered;
+        sf::VertexArray m_front;
+        sf::Transform m_frontTransform;
+        mutable bool m_frontDirty;
+        
+        std::size_t appendCastTriangles(VertexSink& sink) const;
+        
+        bool transformChanged() const;
+        unsigned long occluderVersion() const;
+        bool needsCast(unsigned long edgeVersion) const;
+        void castDone(unsigned long edgeVersion);
     
     public:
         /**
          * @brief Constructor
          */
         LightSource();
+
+        /**
+         * @brief Copy constructor
+         * @details The copy has its own vertex buffer, created when drawn.
+         */
+        LightSource(const LightSource& other);
+
+        /**
+         * @brief Copy assignment
+         * @details The vertex buffer is not copied, but created again when
+         * the light is drawn.
+         */
+        LightSource& operator=(const LightSource& other);
         
          /**
          * @brief Set the light intensity.
@@ -157,6 +353,34 @@ namespace candle{
          */
         float getRange() const;
         
+        /**
+         * @brief Get the global bounding rectangle of the illuminated area.
+         * @details It may be bigger than the polygon, but never smaller.
+         * The default implementation returns the bounds of the polygon
+         * that is drawn.
+         * @returns The global bounding rectangle in float.
+         */
+        virtual sf::FloatRect getGlobalBounds() const;
+        
+        /**
+         * @brief Get the light that a point would receive without shadows.
+         * @details Only the shape of the light is taken into account, not
+         * the edges nor the polygon of the last cast, so it doesn't need
+         * the light to be casted. To check if the point is in the shadow of
+         * an edge, test the visibility between the point and @p source,
+         * as @ref lightAt does.
+         *
+         * The default implementation returns 0, with @p source at the
+         * position of the light, for lights that don't know their shape.
+         * @param point Point in global coordinates.
+         * @param source (Output argument) Point from which the light reaches
+         * @p point.
+         * @returns The intensity of the light at @p point, with the fade
+         * applied, or 0 if it is out of the range or the beam.
+         * @see lightAt, getIntensity
+         */
+        virtual float getIntensityAt(const sf::Vector2f& point, sf::Vector2f& source) const;
+        
         /**
          * @brief Modify the polygon of the illuminated area with a 
          * raycasting algorithm.
@@ -170,6 +394,320 @@ namespace candle{
          * @see setRange, [EdgeVector](@ref LightSource.hpp)
          */
         virtual void castLight(const EdgeVector::iterator& begin, const EdgeVector::iterator& end) = 0;
+        
+        /**
+         * @brief Modify the polygon of the illuminated area with a 
+         * raycasting algorithm.
+         * @details Same as the version with iterators, but the edges are
+         * taken from an @ref EdgeIndex, so only the ones near the light and
+         * the rays are tested.
+         *
+         * The default implementation copies the edges of the index and
+         * calls the version with iterators.
+         * @param index Spatial index of the edges to take into account.
+         * @see setRange, EdgeIndex
+         */
+        virtual void castLight(const EdgeIndex& index);
+
+        /**
+         * @brief Modify the polygon of the illuminated area with a
+         * raycasting algorithm.
+         * @details Same as the version with iterators, but the rays are
+         * tested against several edges of the @ref EdgeBuffer at a time.
+         *
+         * The default implementation copies the edges of the buffer and
+         * calls the version with iterators.
+         * @param edges Buffer of the edges to take into account.
+         * @see setRange, EdgeBuffer
+         */
+        virtual void castLight(const EdgeBuffer& edges);
+
+        /**
+         * @brief Modify the polygon of the illuminated area with a
+         * raycasting algorithm.
+         * @details Same as the version with iterators, but the edges are
+         * taken from an @ref EdgeMesh, so the rays that its shared vertices
+         * and solid sides make redundant are not casted.
+         *
+         * The default implementation copies the edges of the mesh and
+         * calls the version with iterators.
+         * @param mesh Mesh of the edges to take into account.
+         * @see setRange, EdgeMesh
+         */
+        virtual void castLight(const EdgeMesh& mesh);
+
+        /**
+         * @brief Cast the light only if something changed since the last
+         * time.
+         * @details The light is casted again if its transform, its range or
+         * any parameter of its shape changed since the last call to a
+         * castLightIfNeeded function, or if @p edgeVersion is different.
+         * Otherwise, the function returns immediately and the polygon is
+         * kept as it is.
+         *
+         * The edges of a vector have no version, so it is up to the caller
+         * to take a new one with @ref newEdgeVersion whenever they change.
+         * A direct call to castLight makes the next call to this function
+         * cast the light again.
+         * @param begin Iterator to the first sfu::Line of the vector to take
+         * into account.
+         * @param end Iterator to the first sfu::Line of the vector not to be
+         * taken into account.
+         * @param edgeVersion Version of the edges in the range.
+         * @returns True if the light was casted.
+         * @see castLight, newEdgeVersion
+         */
+        bool castLightIfNeeded(const EdgeVector::iterator& begin, const EdgeVector::iterator& end, unsigned long edgeVersion);
+
+        /**
+         * @brief Cast the light only if something changed since the last
+         * time.
+         * @details Same as the version with iterators, with the version of
+         * the index. If only some edges of the index were modified with
+         * @ref EdgeIndex::update since the last cast, the light is not casted
+         * again unless it may see them, and then only the part of the
+         * polygon that they may affect is computed again, if the light type
+         * supports it.
+         * @param index Spatial index of the edges to take into account.
+         * @returns True if the light was casted.
+         * @see EdgeIndex::getVersion
+         */
+        bool castLightIfNeeded(const EdgeIndex& index);
+
+        /**
+         * @brief Cast the light only if something changed since the last
+         * time.
+         * @details Same as the version with iterators, with the version of
+         * the buffer.
+         * @param edges Buffer of the edges to take into account.
+         * @returns True if the light was casted.
+         * @see EdgeBuffer::getVersion
+         */
+        bool castLightIfNeeded(const EdgeBuffer& edges);
+
+        /**
+         * @brief Cast the light only if something changed since the last
+         * time.
+         * @details Same as the version with iterators, with the version of
+         * the mesh.
+         * @param mesh Mesh of the edges to take into account.
+         * @returns True if the light was casted.
+         * @see EdgeMesh::getVersion
+         */
+        bool castLightIfNeeded(const EdgeMesh& mesh);
+
+        /**
+         * @brief Cast the light and write its polygon into a buffer of the
+         * application.
+         * @details Calls castLight, and then writes the new polygon to
+         * @p sink as separate triangles in global coordinates, like
+         * @ref appendTriangles. This way the polygons of many lights can go
+         * straight to a buffer of their own, like a mapped sf::VertexBuffer,
+         * without being copied to a sf::VertexArray first. The triangles are
+         * the ones of this cast even if the light is double buffered.
+         * @param begin Iterator to the first sfu::Line of the vector to take
+         * into account.
+         * @param end Iterator to the first sfu::Line of the vector not to be
+         * taken into account.
+         * @param sink Buffer to write the triangles to.
+         * @returns The index in @p sink of the first vertex of the light, or
+         * VertexSink::FULL if they didn't fit and nothing was written.
+         * @see VertexSink, getTriangleVertexCount
+         */
+        std::size_t castLightInto(const EdgeVector::iterator& begin, const EdgeVector::iterator& end, VertexSink& sink);
+
+        /**
+         * @brief Cast the light and write its polygon into a buffer of the
+         * application.
+         * @details Same as the version with iterators, with the edges of an
+         * @ref EdgeIndex, an @ref EdgeBuffer or an @ref EdgeMesh.
+         * @param edges Edges to take into account.
+         * @param sink Buffer to write the triangles to.
+         * @returns The index in @p sink of the first vertex of the light, or
+         * VertexSink::FULL if they didn't fit and nothing was written.
+         */
+        template <typename Edges>
+        std::size_t castLightInto(const Edges& edges, VertexSink& sink){
+            castLight(edges);
+            return appendCastTriangles(sink);
+        }
+
+        /**
+         * @brief Get the number of vertices of the drawn polygon split in
+         * triangles.
+         * @returns The number of vertices that @ref appendTriangles adds.
+         */
+        std::size_t getTriangleVertexCount() const;
+
+        /**
+         * @brief Append the drawn polygon of the light to an array of
+         * triangles.
+         * @details The positions are transformed to global coordinates, and
+         * the colors and texture coordinates are kept.
+         * @param triangles Array of sf::Triangles to append to.
+         */
+        void appendTriangles(sf::VertexArray& triangles) const;
+
+        /**
+         * @brief Append the drawn polygon of the light to a buffer of
+         * triangles.
+         * @details Same as the version with an array, without resizing it.
+         * @param sink Buffer to write the triangles to.
+         * @returns The index in @p sink of the first vertex of the light, or
+         * VertexSink::FULL if they didn't fit and nothing was written.
+         */
+        std::size_t appendTriangles(VertexSink& sink) const;
+
+        /**
+         * @brief Set the buffers to use for the computations of castLight.
+         * @details The scratch is not owned by the light, and must outlive
+         * it or be removed before being destroyed. Lights that share a
+         * scratch must not be casted at the same time from different
+         * threads.
+         *
+         * By default, the light uses the scratch of the thread that casts it.
+         * @param scratch Buffers to use, or nullptr to use the ones of the
+         * calling thread.
+         * @see getCastScratch, CastScratch::getThreadScratch
+         */
+        void setCastScratch(CastScratch* scratch);
+
+        /**
+         * @brief Get the buffers set with @ref setCastScratch.
+         * @returns The scratch of the light, or nullptr if it uses the one of
+         * the calling thread.
+         */
+        CastScratch* getCastScratch() const;
+
+        /**
+         * @brief Set the occluders that cast shadows along with the edges.
+         * @details The occluders are used in every castLight, whatever the
+         * edges are given in, and castLightIfNeeded casts the light again
+         * when they change. The list is not owned by the light, and must
+         * outlive it or be removed before being destroyed.
+         * @param occluders List of occluders, or nullptr for none.
+         * @see getOccluders, OccluderList
+         */
+        void setOccluders(const OccluderList* occluders);
+
+        /**
+         * @brief Get the occluders set with @ref setOccluders.
+         * @returns The list of occluders, or nullptr if there is none.
+         */
+        const OccluderList* getOccluders() const;
+
+        /**
+         * @brief Set where the vertices of the polygon are kept for drawing.
+         * @details With VERTEX_ARRAY, the polygon is sent to the graphics
+         * card every time the light is drawn. With VERTEX_BUFFER, it is kept
+         * in a sf::VertexBuffer, and only sent again when castLight or a
+         * change of color modifies it. This saves bandwidth for lights that
+         * are drawn many times between casts, like static lights or lights
+         * drawn to several targets.
+         *
+         * If the system doesn't support vertex buffers, the light is drawn
+         * as with VERTEX_ARRAY. The buffer is only created the first time
+         * the light is drawn with VERTEX_BUFFER, so the lights can be
+         * created and casted without a graphics context, like in a server.
+         *
+         * The default value is VERTEX_ARRAY.
+         * @param storage Where to keep the vertices.
+         * @see getVertexStorage
+         */
+        void setVertexStorage(VertexStorage storage);
+
+        /**
+         * @brief Get where the vertices of the polygon are kept for drawing.
+         * @returns The storage of the vertices.
+         * @see setVertexStorage
+         */
+        VertexStorage getVertexStorage() const;
+
+        /**
+         * @brief Set the level of detail of the casts.
+         * @details With a tolerance greater than 0, castLight simplifies
+         * the polygon, ignoring the details smaller than @p tolerance. The
+         * ends of edges shorter than the tolerance are not used to cast
+         * rays, although the edges still block other rays.
+         *
+         * If the whole light is less than 32 times the tolerance across, so
+         * that it is a few pixels on screen, the cast is coarser:
+         *   - Rays closer than the tolerance at the end of their range are
+         *     merged into one.
+         *   - The extra rays that are casted next to each end of an edge,
+         *     to find what is behind it, are not casted.
+         *
+         * The shadows of a coarse light may leak past the corners of the
+         * edges, which is only acceptable because the light is too small to
+         * tell. This makes the casts of distant or tiny lights much cheaper.
+         * The SWEEP algorithm of @ref RadialLight ignores the tolerance.
+         *
+         * The default value is 0, with all the details.
+         * @param tolerance Size of the smallest detail, in world units.
+         * @see getLodTolerance, setLodFromView
+         */
+        void setLodTolerance(float tolerance);
+
+        /**
+         * @brief Get the level of detail of the casts.
+         * @returns The size of the smallest detail, in world units.
+         * @see setLodTolerance
+         */
+        float getLodTolerance() const;
+
+        /**
+         * @brief Set the level of detail from the view used to draw the
+         * light.
+         * @details The tolerance is set to the size of a pixel of the view,
+         * rounded up to a power of two so that small zooms don't change it
+         * in every frame. If the light is out of the view, the tolerance is
+         * its range, the lowest detail. If it is more than 128 pixels across,
+         * the tolerance is 0, with all the details.
+         * @param view View used to draw the light.
+         * @param pixels Number of pixels across the view, in its biggest
+         * dimension.
+         * @see setLodTolerance
+         */
+        void setLodFromView(const sf::View& view, float pixels = 1024.f);
+
+        /**
+         * @brief Keep a second polygon to draw while the light is casted.
+         * @details
+         *
+         * A double buffered light keeps drawing the polygon it had in the
+         * last call to @ref swapBuffers, while castLight computes the next
+         * one apart. This way the light can be drawn in one thread while
+         * it is casted in another one, like in a @ref CastPipeline. The
+         * polygon is drawn with the transform the light had when it was
+         * swapped, so a light that is casted in the background can be moved
+         * before its last cast is drawn.
+         *
+         * While the light is casted, it can be drawn, but no other function
+         * can be called on it. @ref swapBuffers must be called after the cast
+         * finishes and before the light is modified.
+         *
+         * The default value is false.
+         * @param doubleBuffered True to draw the polygon of the last swap.
+         * @see isDoubleBuffered, swapBuffers
+         */
+        void setDoubleBuffered(bool doubleBuffered);
+
+        /**
+         * @brief Tell if the light is double buffered.
+         * @returns True if the light draws the polygon of the last swap.
+         * @see setDoubleBuffered
+         */
+        bool isDoubleBuffered() const;
+
+        /**
+         * @brief Draw the polygon of the last cast from now on.
+         * @details Only swaps two buffers, so it is cheap. Nothing happens if
+         * the light is not double buffered, or if it wasn't casted since the
+         * last swap.
+         * @returns True if the drawn polygon changed.
+         * @see setDoubleBuffered
+         */
+        bool swapBuffers();
     };
 }
 
@@ -7,12 +7,15 @@
 #ifndef __CANDLE_LIGHTING_HPP__
 #define __CANDLE_LIGHTING_HPP__
 
+#include <memory>
 #include <set>
+#include <vector>
 
 #include "SFML/Graphics.hpp"
 
 #include "Candle/geometry/Line.hpp"
 #include "Candle/LightSource.hpp"
+#include "Candle/LightBatch.hpp"
 
 namespace candle{
     /**
@@ -85,13 +88,29 @@ namespace candle{
         sf::Color m_color;
         float m_opacity;
         sf::Vector2f m_size;
+        float m_resolutionScale;
         Mode m_mode;
+        static const unsigned int MAX_DIRTY_RECTS = 16;
+        std::vector<sf::IntRect> m_dirtyRects; // in local coordinates
+        bool m_fullyDirty;
+        bool m_clipping; // lights are only drawn in the dirty rects
+        sf::Transform m_clearTransform;
+        std::vector<const LightSource*> m_staticLights;
+        std::unique_ptr<sf::RenderTexture> m_staticTexture;
+        bool m_staticDirty; // the static lights have to be drawn again
         /**
          * @brief Draw the object to the target.
          */
         void draw(sf::RenderTarget&, sf::RenderStates)const override;
         sf::Color getActualColor() const;
         void initializeRenderTexture(const sf::Vector2f& size);
+        sf::Transform getFogTransform() const;
+        sf::View getClipView(const sf::IntRect& rect) const;
+        void drawClipped(const sf::Drawable& d, const sf::FloatRect* bounds);
+        bool transformChanged() const;
+        void clearBase(sf::RenderTexture& target);
+        void updateStaticCache();
+        void drawStaticCache();
     public:
         
         /**
@@ -214,12 +233,120 @@ namespace candle{
          */
         Mode getMode() const;
         
+        /**
+         * @brief Set the resolution of the area, relative to its size.
+         * @details Fog and ambient light rarely have small details, so
+         * they can be drawn at a lower resolution, like 1/2 or 1/4, and
+         * stretched to the size of the area when it is drawn. This divides
+         * the number of pixels to fill by the square of @p scale's inverse,
+         * at the cost of blurrier borders.
+         * 
+         * The sf::RenderTexture is created again, so the area has to be
+         * cleared after this call.
+         * 
+         * The default value is 1.
+         * @param scale Value greater than 0 and up to 1. Bigger values are
+         * taken as 1, and the rest are ignored.
+         * @see getResolutionScale
+         */
+        void setResolutionScale(float scale);
+        
+        /**
+         * @brief Get the resolution of the area, relative to its size.
+         * @returns The resolution scale.
+         * @see setResolutionScale
+         */
+        float getResolutionScale() const;
+        
         /**
          * @brief Updates and restores the color and the texture.
          * @details In FOG mode, it restores the covered areas.
          */
         void clear();
         
+        /**
+         * @brief Mark a region of the area to be restored by the next call
+         * to @ref clearDirty.
+         * @details Overlapping regions are merged, and if there are too many
+         * they are replaced by their bounding rectangle.
+         * @param rect Region to restore, in global coordinates.
+         * @see invalidate(const LightSource&)
+         */
+        void invalidate(const sf::FloatRect& rect);
+        
+        /**
+         * @brief Mark the region covered by a light to be restored by the
+         * next call to @ref clearDirty.
+         * @details Call it before moving or casting the light, and again
+         * after, so that both the old and the new illuminated areas are
+         * restored.
+         * @param light
+         * @see LightSource::getGlobalBounds
+         */
+        void invalidate(const LightSource& light);
+        
+        /**
+         * @brief Restore only the regions marked with @ref invalidate.
+         * @details Instead of the whole area, only the marked regions are
+         * restored, and until the next call to @ref display the lights are
+         * only drawn inside them, so everything else keeps the lights
+         * drawn in previous frames. All the lights have to be drawn again
+         * anyway, but the ones that don't touch any region are skipped.
+         * 
+         * If the color, opacity, texture, mode or transform of the area
+         * changed, the whole area is cleared as with @ref clear.
+         */
+        void clearDirty();
+        
+        /**
+         * @brief Add a light that is drawn in every clear.
+         * @details In FOG mode, the static lights are drawn once into a
+         * cache texture, together with the color or texture of the area,
+         * and @ref clear and @ref clearDirty restore the area from the
+         * cache. This way, only the lights that move have to be drawn
+         * every frame. The static lights must not be drawn with
+         * @ref draw(const LightSource&).
+         * 
+         * The light is not copied, so it must outlive the area or be
+         * removed before it is destroyed. If the light changes, the cache
+         * has to be updated with @ref invalidateStatic.
+         * @param light
+         * @see removeStatic, clearStatic
+         */
+        void addStatic(const LightSource& light);
+        
+        /**
+         * @brief Remove a light added with @ref addStatic.
+         * @param light
+         */
+        void removeStatic(const LightSource& light);
+        
+        /**
+         * @brief Remove all the lights added with @ref addStatic.
+         * @details The memory of the cache is released.
+         */
+        void clearStatic();
+        
+        /**
+         * @brief Draw the static lights again in the next clear.
+         * @details Needed after recasting, moving or recoloring a static
+         * light. Changes to the color, opacity, texture, mode or
+         * transform of the area update the cache on their own.
+         * @see addStatic
+         */
+        void invalidateStatic();
+        
+        /**
+         * @brief Draw the static lights again in the next clear, if any of
+         * them may be affected by a change in a region.
+         * @details Meant to be called with the bounds of the edges that
+         * change, for example from the callback of
+         * @ref EdgeIndex::setChangeCallback.
+         * @param rect Region that changed, in global coordinates.
+         * @see addStatic
+         */
+        void invalidateStatic(const sf::FloatRect& rect);
+        
         /**
          * @brief In FOG mode, makes visible the area illuminated by the light.
          * @details In FOG mode with opacity greater than zero, this function.
@@ -229,9 +356,20 @@ namespace candle{
          */
         void draw(const LightSource& light);
         
+        /**
+         * @brief In FOG mode, makes visible the area illuminated by a batch
+         * of lights.
+         * @details Same as drawing each light of the batch, but with one
+         * draw call for all of them.
+         * @param batch
+         * @see LightBatch
+         */
+        void draw(const LightBatch& batch);
+        
         /**
          * @brief Calls display on the sf::RenderTexture.
-         * @details Updates the changes made since the last call to @ref clear.
+         * @details Updates the changes made since the last call to @ref clear
+         * or @ref clearDirty, and forgets the regions marked to restore.
          */
         void display();
     };
@@ -0,0 +1,283 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the occluder shapes and the OccluderList class.
+ */
+#ifndef __CANDLE_OCCLUDER_HPP__
+#define __CANDLE_OCCLUDER_HPP__
+
+#include <cmath>
+#include <vector>
+
+#include "SFML/Graphics/Rect.hpp"
+#include "SFML/Graphics/Transform.hpp"
+#include "SFML/System/Vector2.hpp"
+
+#include "Candle/LightSource.hpp"
+
+namespace candle{
+    /**
+     * @brief Solid circle that casts shadows.
+     * @see OccluderList
+     */
+    struct Circle{
+        sf::Vector2f center; ///< Center of the circle.
+        float radius; ///< Radius of the circle.
+    };
+
+    /**
+     * @brief Solid convex polygon that casts shadows.
+     * @details The points are kept counterclockwise, in the sense of a
+     * positive area, whatever the order they are given in. If they don't
+     * make a convex polygon, the shadows are not correct.
+     * @see OccluderList
+     */
+    class ConvexPolygon{
+    private:
+        std::vector<sf::Vector2f> m_points;
+        sf::Vector2f m_center;
+        float m_radius;
+
+        friend class OccluderList;
+
+    public:
+        /**
+         * @brief Constructor.
+         * @details Constructs a polygon without points, that casts no
+         * shadow.
+         */
+        ConvexPolygon();
+
+        /**
+         * @brief Constructor.
+         * @param points Array of at least three points, in order around the
+         * polygon.
+         * @param n Number of points.
+         */
+        ConvexPolygon(const sf::Vector2f* points, unsigned int n);
+
+        /**
+         * @brief Constructor.
+         * @details Constructs the polygon of a rectangle, like the box of an
+         * entity, transformed.
+         * @param rect Rectangle in local coordinates.
+         * @param transform Transform to apply to its corners, like the one of
+         * the entity.
+         */
+        explicit ConvexPolygon(const sf::FloatRect& rect, const sf::Transform& transform = sf::Transform::Identity);
+
+        /**
+         * @brief Get the points of the polygon.
+         * @returns The points, counterclockwise.
+         */
+        const std::vector<sf::Vector2f>& getPoints() const;
+
+        /**
+         * @brief Get a circle around the points, centered at their average.
+         * @param center Center of the circle.
+         * @param radius Radius of the circle.
+         */
+        void getBoundingCircle(sf::Vector2f& center, float& radius) const;
+    };
+
+    /**
+     * @brief List of moving shapes that cast shadows.
+     * @details
+     *
+     * Entities like characters or crates are often better described by a
+     * circle or a rotated box than by edges. Tessellating them in edges of
+     * an @ref EdgeVector every frame costs many rays for each curve, and
+     * moving them in an @ref EdgeIndex makes the static edges be queried
+     * again. An OccluderList keeps them apart, and the lights that use it
+     * treat them as the shapes they are: a circle gets the two rays tangent
+     * to it and a few over the side that faces the light, and a convex
+     * polygon only gets rays to the vertices of its silhouette and of its
+     * front.
+     *
+     * A light uses the occluders of the list given with
+     * @ref LightSource::setOccluders in every castLight, along with the
+     * edges it is casted with. The occluders that contain a RadialLight
+     * don't cast its shadow, so a light can carry the occluder of its own
+     * entity.
+     *
+     * The list takes a new version from @ref newEdgeVersion every time it
+     * changes, so the lights that use it are casted again by
+     * castLightIfNeeded.
+     */
+    class OccluderList{
+    private:
+        std::vector<Circle> m_circles;
+        std::vector<ConvexPolygon> m_polygons;
+        unsigned long m_version;
+
+        // The occluders are identified by the index of the circles, and then
+        // the index of the polygons after the last circle. The ones that
+        // contain the point outside, if any, are left out.
+        bool contains(unsigned int id, const sf::Vector2f& point) const;
+        void query(const sf::FloatRect& bounds, const sf::Vector2f* outside, std::vector<unsigned int>& ids) const;
+        // The visitors are templates so that the casts can inline them
+        template <typename VertexVisitor>
+        void visitVertices(const std::vector<unsigned int>& ids, const sf::Vector2f& source, bool directional, float tolerance, const VertexVisitor& f) const;
+        template <typename EdgeVisitor>
+        void visitEdges(const std::vector<unsigned int>& ids, const sf::Vector2f& source, float tolerance, const EdgeVisitor& f) const;
+        // The arc of a circle that faces the light goes from -half to half
+        // radians around toSource, in the given number of pieces
+        static void getArc(const Circle& c, const sf::Vector2f& source, bool directional, float tolerance, sf::Vector2f& toSource, float& half, unsigned int& pieces);
+        template <typename PointVisitor>
+        static void visitArc(const Circle& c, const sf::Vector2f& source, bool directional, float tolerance, const PointVisitor& f);
+        static float crossProduct(const sf::Vector2f& a, const sf::Vector2f& b){
+            return a.x * b.y - a.y * b.x;
+        }
+        bool castRay(const std::vector<unsigned int>& ids, const sfu::Line& ray, float& distance) const;
+
+        friend class RadialLight;
+        friend class DirectedLight;
+
+    public:
+        /**
+         * @brief Constructor.
+         * @details Constructs an empty list.
+         */
+        OccluderList();
+
+        /**
+         * @brief Remove all the occluders.
+         */
+        void clear();
+
+        /**
+         * @brief Add a circle.
+         * @param circle Circle to add.
+         * @returns The index of the circle.
+         */
+        unsigned int addCircle(const Circle& circle);
+
+        /**
+         * @brief Move or resize a circle.
+         * @param i Index of the circle.
+         * @param circle New circle.
+         */
+        void setCircle(unsigned int i, const Circle& circle);
+
+        /**
+         * @brief Add a convex polygon.
+         * @param polygon Polygon to add.
+         * @returns The index of the polygon.
+         */
+        unsigned int addPolygon(const ConvexPolygon& polygon);
+
+        /**
+         * @brief Move or change a convex polygon.
+         * @param i Index of the polygon.
+         * @param polygon New polygon.
+         */
+        void setPolygon(unsigned int i, const ConvexPolygon& polygon);
+
+        /**
+         * @brief Get the circles of the list.
+         * @returns The circles, by index.
+         */
+        const std::vector<Circle>& getCircles() const;
+
+        /**
+         * @brief Get the convex polygons of the list.
+         * @returns The polygons, by index.
+         */
+        const std::vector<ConvexPolygon>& getPolygons() const;
+
+        /**
+         * @brief Get the version of the occluders.
+         * @returns The version of the list.
+         * @see LightSource::castLightIfNeeded
+         */
+        unsigned long getVersion() const;
+    };
+
+    // Visits the points of the arc of a circle that faces the light, from
+    // one tangent point to the other, telling if each one is a tangent
+    template <typename PointVisitor>
+    void OccluderList::visitArc(const Circle& c, const sf::Vector2f& source, bool directional, float tolerance, const PointVisitor& f){
+        sf::Vector2f toSource;
+        float half;
+        unsigned int n;
+        getArc(c, source, directional, tolerance, toSource, half, n);
+        for(unsigned int k = 0; k <= n; k++){
+            float a = -half + 2 * half * k / n;
+            float cos = std::cos(a), sin = std::sin(a);
+            sf::Vector2f r(toSource.x * cos - toSource.y * sin, toSource.x * sin + toSource.y * cos);
+            f(c.center + c.radius * r, k == 0 || k == n);
+        }
+    }
+
+    template <typename VertexVisitor>
+    void OccluderList::visitVertices(const std::vector<unsigned int>& ids, const sf::Vector2f& source, bool directional, float tolerance, const VertexVisitor& f) const{
+        // The flags are the ones of the rays around each vertex, as in
+        // RadialLight::castLightRays
+        for(unsigned int id: ids){
+            if(id < m_circles.size()){
+                // Just past the tangents, one ray touches the circle and the
+                // other one passes by
+                visitArc(m_circles[id], source, directional, tolerance, [&](const sf::Vector2f& p, bool tangent){
+                    f(p, tangent ? 5 : 2);
+                });
+                continue;
+            }
+            const std::vector<sf::Vector2f>& points = m_polygons[id - m_circles.size()].m_points;
+            unsigned int n = points.size();
+            auto facing = [&](const sf::Vector2f& a, const sf::Vector2f& b){
+                if(directional){
+                    return crossProduct(b - a, source) > 0.f;
+                }
+                return crossProduct(b - a, source - a) < 0.f;
+            };
+            for(unsigned int i = 0; i < n; i++){
+                const sf::Vector2f& p = points[i];
+                const sf::Vector2f& prev = points[(i+n-1) % n];
+                const sf::Vector2f& next = points[(i+1) % n];
+                if(!facing(prev, p) && !facing(p, next)){
+                    // Behind the polygon itself
+                    continue;
+                }
+                sf::Vector2f d = directional ? source : p - source;
+                float s1 = crossProduct(d, prev - p);
+                float s2 = crossProduct(d, next - p);
+                bool before = s1 < 0.f || s2 < 0.f;
+                bool after = s1 > 0.f || s2 > 0.f;
+                if(before && after){
+                    f(p, 2);
+                }else if(before || after){
+                    f(p, 5);
+                }else{
+                    f(p, 7);
+                }
+            }
+        }
+    }
+
+    template <typename EdgeVisitor>
+    void OccluderList::visitEdges(const std::vector<unsigned int>& ids, const sf::Vector2f& source, float tolerance, const EdgeVisitor& f) const{
+        for(unsigned int id: ids){
+            if(id < m_circles.size()){
+                // The chords of the arc are inside the circle, so the shadow
+                // begins a bit farther than the circle
+                bool first = true;
+                sf::Vector2f last;
+                visitArc(m_circles[id], source, false, tolerance, [&](const sf::Vector2f& p, bool){
+                    if(!first){
+                        f(sfu::Line(last, p));
+                    }
+                    first = false;
+                    last = p;
+                });
+                continue;
+            }
+            const std::vector<sf::Vector2f>& points = m_polygons[id - m_circles.size()].m_points;
+            for(unsigned int i = 0; i < points.size(); i++){
+                f(sfu::Line(points[i], points[(i+1) % points.size()]));
+            }
+        }
+    }
+}
+
+#endif
@@ -7,9 +7,45 @@
 #ifndef __CANDLE_RADIAL_LIGHT_HPP__
 #define __CANDLE_RADIAL_LIGHT_HPP__
 
+#include <string>
+
 #include "Candle/LightSource.hpp"
+#include "Candle/CastScratch.hpp"
 
 namespace candle{
+    /**
+     * @brief Beam of a @ref RadialLightT that always covers 360º.
+     * @details The casts don't check the limits of the beam.
+     */
+    struct FullCircle{
+        static bool isLimited(float){ return false; }
+    };
+
+    /**
+     * @brief Beam of a @ref RadialLightT limited by its beam angle, as the
+     * one of a RadialLight.
+     */
+    struct AnyBeam{
+        static bool isLimited(float beamAngle){ return beamAngle >= 0.1f; }
+    };
+
+    /**
+     * @brief Fade of a @ref RadialLightT that fades towards its range.
+     */
+    struct Fade{
+        static const bool value = true;
+    };
+
+    /**
+     * @brief Fade of a @ref RadialLightT that doesn't fade.
+     */
+    struct NoFade{
+        static const bool value = false;
+    };
+
+    template <typename Beam, typename Fading>
+    class RadialLightT;
+
     /**
      * @brief LightSource that emits light from a single point
      * @details
@@ -30,12 +66,95 @@ namespace candle{
      * </table>
      */
     class RadialLight: public LightSource{
+    public:
+        /**
+         * @brief Algorithms available to compute the illuminated area.
+         * @see setCastAlgorithm, getCastAlgorithm
+         */
+        enum CastAlgorithm {
+            /**
+             * Cast three rays to each end of the edges in range, sort them
+             * by angle and intersect each one with the edges. This is the
+             * reference algorithm.
+             */
+            RAYCAST,
+            /**
+             * Sort the ends of the edges in range by angle once and sweep
+             * them, keeping the edges crossed by the sweep ordered by
+             * distance. It only computes the points where the closest edge
+             * changes, so it scales better with many edges in range. Like
+             * RAYCAST, it assumes that the edges don't intersect.
+             */
+            SWEEP
+        };
+
+        /**
+         * @brief Ways to compute how the lights fade towards their range.
+         * @details In the formulas, d is the distance to the center of the
+         * light, relative to its range.
+         * @see setFalloff, getFalloff
+         */
+        enum Falloff {
+            /**
+             * Sample a prebaked texture with a linear gradient. It is the
+             * only one that doesn't need shaders.
+             */
+            TEXTURE,
+            /** Computed by a shader as 1 - d. */
+            LINEAR,
+            /** Computed by a shader as (1 - d)². */
+            QUADRATIC,
+            /** Computed by a shader as 1 - smoothstep(0, 1, d). */
+            SMOOTH,
+            /** Computed by a shader with the function set with @ref setFalloffFunction. */
+            CUSTOM
+        };
+
     private:
+        typedef CastScratch::AngleRange AngleRange;
+
         static int s_instanceCount;
+        static Falloff s_falloff;
         float m_beamAngle;
+        CastAlgorithm m_castAlgorithm;
+        // Hit points of the last RAYCAST cast and their relative angles
+        std::vector<float> m_hitAngles;
+        std::vector<sf::Vector2f> m_hits;
 
         void draw(sf::RenderTarget& t, sf::RenderStates st) const override;
+        void drawLight(sf::RenderTarget& t, sf::RenderStates st, bool fade) const;
         void resetColor() override;
+        sf::Transform getPolygonTransform() const override;
+        // Bounds at the current position, for the casts
+        sf::FloatRect getCastBounds() const;
+        bool castLightChanges(const EdgeIndex& index, const std::vector<EdgeChange>& changes) override;
+
+        // The casts, with the beam of a RadialLightT, or AnyBeam
+        template <typename Beam>
+        void castLightWith(const EdgeVector::iterator& begin, const EdgeVector::iterator& end);
+        template <typename Beam>
+        void castLightWith(const EdgeBuffer& edges);
+        template <typename Beam>
+        void castLightWith(const EdgeMesh& mesh);
+        template <typename Beam>
+        bool castLightChangesWith(const EdgeIndex& index, const std::vector<EdgeChange>& changes);
+        template <typename Beam>
+        void castLightIndex(const EdgeIndex& index, const std::vector<AngleRange>* window);
+        template <typename Beam, typename VertexVisitor, typename RayCaster>
+        void castLightRays(const VertexVisitor& forEachVertex, const RayCaster& caster, const std::vector<AngleRange>* window = nullptr);
+        template <typename Beam, typename EdgeVisitor>
+        void castLightSweep(const EdgeVisitor& forEachEdge);
+        template <typename Beam>
+        void setPolygon(const std::vector<sf::Vector2f>& hits);
+        std::size_t countTriangleVertices(const sf::VertexArray& polygon) const override;
+        void writeTriangles(const sf::VertexArray& polygon, const sf::Transform& transform, sf::Vertex* triangles) const override;
+        float getFalloffAt(const sf::Vector2f& texCoords) const override;
+        bool getFalloffCircle(sf::Vector2f& center, float& radius) const override;
+        static void setLightStates(sf::RenderStates& s, bool fade);
+
+        friend class LightBatch;
+        template <typename Beam, typename Fading>
+        friend class RadialLightT;
 
     public:
         /**
@@ -50,6 +169,12 @@ namespace candle{
 
         void castLight(const EdgeVector::iterator& begin, const EdgeVector::iterator& end) override;
 
+        void castLight(const EdgeIndex& index) override;
+
+        void castLight(const EdgeBuffer& edges) override;
+
+        void castLight(const EdgeMesh& mesh) override;
+
         /**
          * @brief Set the range for which rays may be casted.
          * @details The angle shall be specified in degrees. The angle in which the rays will be casted will be
@@ -57,27 +182,166 @@ namespace candle{
          * @param angle
          * @see getBeamAngle
          */
-        void setBeamAngle(float angle);
+        virtual void setBeamAngle(float angle);
 
         /**
          * @brief Get the range for which rays may be casted.
          * @details It defaults to 360º.
          * @see setBeamAngle
          */
-        float getBeamAngle() const;
-
-        /**
-         * @brief Get the local bounding rectangle of the light.
-         * @returns The local bounding rectangle in float.
-         */
-        sf::FloatRect getLocalBounds() const;
-
-        /**
-         * @brief Get the global bounding rectangle of the light.
-         * @returns The global bounding rectangle in float.
-         */
-        sf::FloatRect getGlobalBounds() const;
+        float getBeamAngle() const;
+
+        /**
+         * @brief Set the algorithm used by @ref castLight.
+         * @details Both algorithms produce the same illuminated area, but
+         * with a different number of vertices.
+         * 
+         * The default value is RAYCAST.
+         * @param algorithm
+         * @see getCastAlgorithm, CastAlgorithm
+         */
+        void setCastAlgorithm(CastAlgorithm algorithm);
+
+        /**
+         * @brief Get the algorithm used by @ref castLight.
+         * @returns The algorithm used to cast the light.
+         * @see setCastAlgorithm
+         */
+        CastAlgorithm getCastAlgorithm() const;
+
+        /**
+         * @brief Get the local bounding rectangle of the light.
+         * @returns The local bounding rectangle in float.
+         */
+        sf::FloatRect getLocalBounds() const;
 
+        /**
+         * @brief Get the global bounding rectangle of the light.
+         * @details If the light is double buffered, it is the one of the
+         * polygon that is drawn, as it was in the last
+         * @ref LightSource::swapBuffers.
+         * @returns The global bounding rectangle in float.
+         */
+        sf::FloatRect getGlobalBounds() const override;
+
+        float getIntensityAt(const sf::Vector2f& point, sf::Vector2f& source) const override;
+
+        /**
+         * @brief Set how all the RadialLights fade towards their range.
+         * @details With TEXTURE, the lights sample two prebaked textures,
+         * one for the lights that fade and one for the ones that don't,
+         * created the first time a light is drawn. The rest of the modes
+         * compute the falloff of each pixel in a fragment shader, so the
+         * textures are not needed and big lights are not blurred.
+         * 
+         * If shaders are not available, or the shader can't be compiled,
+         * the falloff goes back to TEXTURE.
+         * 
+         * The default value is TEXTURE, unless the library is built with
+         * another one in the `CANDLE_FALLOFF` CMake option.
+         * @param falloff New falloff of the lights.
+         * @returns True if the falloff could be set.
+         * @see getFalloff, setFalloffFunction, LightSource::setFade
+         */
+        static bool setFalloff(Falloff falloff);
+
+        /**
+         * @brief Get how the RadialLights fade towards their range.
+         * @returns The falloff of the lights.
+         * @see setFalloff
+         */
+        static Falloff getFalloff();
+
+        /**
+         * @brief Set a custom falloff function and use it for all the
+         * RadialLights.
+         * @details @p function is the body of a GLSL function
+         * `float falloff(float d)`, where `d` goes from 0 in the center of
+         * the light to 1 at its range, that returns the intensity, from 0
+         * to 1. For example, `"return exp(-4.0 * d);"`.
+         * 
+         * The falloff is set to CUSTOM, as with @ref setFalloff.
+         * @param function Body of the falloff function.
+         * @returns True if the falloff could be set.
+         * @see setFalloff
+         */
+        static bool setFalloffFunction(const std::string& function);
+
+    };
+
+    /**
+     * @brief RadialLight with its beam and fade fixed at compile time.
+     * @details
+     *
+     * A RadialLight checks its beam angle and its fade in every cast and
+     * draw. A RadialLightT<FullCircle, Fade> knows them from its type: its
+     * casts skip the checks of the limits of the beam, and its draws pick
+     * the falloff without reading the fade.
+     *
+     * The class is final, so the calls to castLight on a RadialLightT, or
+     * on the elements of a container of them, don't go through the virtual
+     * table. It is still a RadialLight, and it can
+     * be used as any other LightSource.
+     *
+     * @code
+     * std::vector<candle::RadialLightT<candle::FullCircle, candle::Fade>> sparks(1000);
+     * for(auto& spark: sparks){
+     *     spark.castLight(index);
+     * }
+     * @endcode
+     * @tparam Beam @ref FullCircle, or @ref AnyBeam to keep the beam angle.
+     * @tparam Fading @ref Fade or @ref NoFade.
+     */
+    template <typename Beam, typename Fading>
+    class RadialLightT final: public RadialLight{
+    private:
+        void draw(sf::RenderTarget& t, sf::RenderStates st) const override{
+            drawLight(t, st, Fading::value);
+        }
+
+        bool castLightChanges(const EdgeIndex& index, const std::vector<EdgeChange>& changes) override{
+            return castLightChangesWith<Beam>(index, changes);
+        }
+
+    public:
+        /**
+         * @brief Constructor
+         */
+        RadialLightT(){
+            LightSource::setFade(Fading::value);
+        }
+
+        void castLight(const EdgeVector::iterator& begin, const EdgeVector::iterator& end) override{
+            castLightWith<Beam>(begin, end);
+        }
+
+        void castLight(const EdgeIndex& index) override{
+            castLightIndex<Beam>(index, nullptr);
+        }
+
+        void castLight(const EdgeBuffer& edges) override{
+            castLightWith<Beam>(edges);
+        }
+
+        void castLight(const EdgeMesh& mesh) override{
+            castLightWith<Beam>(mesh);
+        }
+
+        /**
+         * @brief Set the range for which rays may be casted.
+         * @details With a @ref FullCircle, the angle is always 360º.
+         * @param angle Angle in degrees.
+         * @see RadialLight::setBeamAngle
+         */
+        void setBeamAngle(float angle) override{
+            RadialLight::setBeamAngle(Beam::isLimited(angle) ? angle : 360.f);
+        }
+
+        /**
+         * @brief Does nothing, since the fade is fixed by the type of the
+         * light.
+         */
+        void setFade(bool) override{}
     };
 }
 
@@ -0,0 +1,224 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the SoftwareLightingArea class.
+ */
+#ifndef __CANDLE_SOFTWARE_LIGHTING_AREA_HPP__
+#define __CANDLE_SOFTWARE_LIGHTING_AREA_HPP__
+
+#include <string>
+#include <vector>
+
+#include "SFML/Graphics.hpp"
+
+#include "Candle/LightingArea.hpp"
+#include "Candle/LightSource.hpp"
+
+namespace candle{
+    class ThreadPool;
+
+    /**
+     * @brief LightingArea rasterized by the CPU, in memory.
+     * @details
+     *
+     * A @ref LightingArea draws with the graphics card, so it needs an
+     * OpenGL context. A SoftwareLightingArea does the same operations in an
+     * array of pixels in memory, without touching the graphics card, so it
+     * can bake lightmaps or compute the fog of war in a server.
+     *
+     * The lights don't need a graphics context either, as long as they are
+     * not drawn to a render target (see @ref LightSource::setVertexStorage),
+     * so the whole process can run without a display. They must be casted
+     * as usual. Drawing a light rasterizes its
+     * polygon with the same result that the LightingArea would give: in FOG
+     * mode, the alpha of each pixel is multiplied by one minus the alpha of
+     * the light, including the falloff of the RadialLights (see
+     * @ref RadialLight::setFalloff; a custom function is taken as linear),
+     * and the color is kept. In AMBIENT mode, drawing lights has no effect.
+     *
+     * The pixels are stored with 4 channels (RGBA) or only the alpha one,
+     * row by row, and there is one for each unit of the area. With a
+     * @ref ThreadPool, the rows are split in bands that are rasterized in
+     * parallel.
+     *
+     * The area only uses a plain color, not a texture.
+     * @see LightingArea
+     */
+    class SoftwareLightingArea: public sf::Transformable{
+    public:
+        /**
+         * @brief Layouts of the pixels.
+         * @see getFormat
+         */
+        enum Format{
+            /**
+             * One byte per pixel, with its alpha.
+             */
+            ALPHA,
+            /**
+             * Four bytes per pixel: red, green, blue and alpha, like
+             * sf::Image.
+             */
+            RGBA
+        };
+
+    private:
+        // Edge of a triangle in pixel coordinates, with its ends in a fixed
+        // order, so the triangles that share it compute the same values
+        struct RasterEdge{
+            sf::Vector2f origin;
+            sf::Vector2f direction;
+            float sign; // makes the edge function positive inside
+            bool owned; // the pixels exactly on the edge are inside
+        };
+        // Triangle in pixel coordinates, with the attributes to interpolate
+        struct Triangle{
+            RasterEdge edges[3]; // edge k is the one opposite to vertex k
+            float alpha[3];
+            sf::Vector2f texCoords[3];
+            float inverseArea;
+            sf::IntRect bounds;
+        };
+
+        LightingArea::Mode m_mode;
+        Format m_format;
+        sf::Vector2u m_size;
+        std::vector<sf::Uint8> m_pixels;
+        sf::Color m_color;
+        float m_opacity;
+        ThreadPool* m_pool;
+        sf::VertexArray m_triangles;
+        std::vector<Triangle> m_raster;
+
+        void rasterize(const LightSource& light, const Triangle& triangle, int top, int bottom);
+
+    public:
+        /**
+         * @brief Constructor.
+         * @details Constructs an area with plain color. It has to be
+         * cleared before drawing lights on it.
+         * @param mode
+         * @param position
+         * @param size Size of the area, that is also its size in pixels.
+         * @param format Layout of the pixels.
+         */
+        SoftwareLightingArea(LightingArea::Mode mode, const sf::Vector2f& position, const sf::Vector2f& size, Format format = RGBA);
+
+        /**
+         * @brief Get the local bounding rectangle of the area.
+         * @returns The local bounding rectangle in float.
+         */
+        sf::FloatRect getLocalBounds() const;
+
+        /**
+         * @brief Get the global bounding rectangle of the area.
+         * @returns The global bounding rectangle in float.
+         */
+        sf::FloatRect getGlobalBounds() const;
+
+        /**
+         * @brief Set color of the fog/light.
+         * @details It is applied by the next call to @ref clear.
+         * @param color
+         */
+        void setAreaColor(sf::Color color);
+
+        /**
+         * @brief Get color of the fog/light.
+         * @returns The plain color of the fog/light.
+         */
+        sf::Color getAreaColor() const;
+
+        /**
+         * @brief Set the opacity of the fog/light.
+         * @details It is applied by the next call to @ref clear.
+         * @param opacity
+         */
+        void setAreaOpacity(float opacity);
+
+        /**
+         * @brief Get the opacity of the fog/light.
+         * @returns The opacity of the fog/light.
+         */
+        float getAreaOpacity() const;
+
+        /**
+         * @brief Set the lighting mode.
+         * @param mode
+         * @see LightingArea::Mode
+         */
+        void setMode(LightingArea::Mode mode);
+
+        /**
+         * @brief Get the lighting mode.
+         * @returns The lighting mode.
+         */
+        LightingArea::Mode getMode() const;
+
+        /**
+         * @brief Set the threads to rasterize with.
+         * @details The pool is not owned by the area, and it must exist
+         * while it is set.
+         * @param pool Pool of threads, or nullptr to rasterize in the
+         * calling thread (the default).
+         */
+        void setThreadPool(ThreadPool* pool);
+
+        /**
+         * @brief Get the threads to rasterize with.
+         * @returns The pool set with @ref setThreadPool.
+         */
+        ThreadPool* getThreadPool() const;
+
+        /**
+         * @brief Fill the area with its color and opacity.
+         */
+        void clear();
+
+        /**
+         * @brief In FOG mode, makes visible the area illuminated by the light.
+         * @param light Light, already casted.
+         */
+        void draw(const LightSource& light);
+
+        /**
+         * @brief Get the size of the area in pixels.
+         * @returns The number of columns and rows of pixels.
+         */
+        sf::Vector2u getSize() const;
+
+        /**
+         * @brief Get the layout of the pixels.
+         * @returns The format given to the constructor.
+         */
+        Format getFormat() const;
+
+        /**
+         * @brief Get the pixels of the area.
+         * @details Row by row, from the top-left corner, with the layout
+         * of @ref getFormat. They can be written to a file or a stream
+         * directly.
+         * @returns Pointer to the first byte of the pixels.
+         */
+        const sf::Uint8* getPixels() const;
+
+        /**
+         * @brief Copy the pixels to an image.
+         * @details With the ALPHA format, the color of the pixels is the
+         * color of the area.
+         * @returns An image of the size of the area.
+         */
+        sf::Image copyToImage() const;
+
+        /**
+         * @brief Save the pixels to an image file.
+         * @param filename Path of the file, with one of the extensions
+         * supported by sf::Image::saveToFile.
+         * @returns True if the file was written.
+         */
+        bool saveToFile(const std::string& filename) const;
+    };
+}
+
+#endif
@@ -0,0 +1,155 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the Stats structure and the profiling hooks.
+ * @details Everything in this file, except the empty macros, is only
+ * compiled if `CANDLE_PROFILE` is defined (see the CMake option of the same
+ * name), so the library has no profiling cost otherwise.
+ */
+#ifndef __CANDLE_STATS_HPP__
+#define __CANDLE_STATS_HPP__
+
+#ifdef CANDLE_PROFILE
+
+#include <chrono>
+#include <functional>
+
+namespace candle{
+    /**
+     * @brief Counters of the work done by the lights and the areas.
+     * @details
+     *
+     * Each @ref LightSource::castLight records the edges it received,
+     * the ones discarded for being out of range, the rays casted, the
+     * segment/ray intersection tests and the vertices of the resulting
+     * polygon. Each operation of a @ref LightingArea records the draw calls
+     * it made and the pixels of the texture they touched, approximated by
+     * their bounding rectangles.
+     *
+     * Each thread adds its counters to a Stats of its own, so the lights
+     * casted by a @ref ThreadPool don't wait for each other. @ref get
+     * returns the sum of all the threads, and @ref reset sets them to
+     * zero, usually once per frame.
+     * The SWEEP algorithm of the RadialLight doesn't cast rays, so it only
+     * records edges and vertices.
+     * @see ProfileEvent
+     */
+    struct Stats{
+        unsigned long casts; ///< Number of calls to castLight.
+        unsigned long edges; ///< Edges passed to castLight.
+        unsigned long culledEdges; ///< Edges discarded for being out of range.
+        unsigned long rays; ///< Rays casted.
+        unsigned long intersectionTests; ///< Segment/ray intersections tested.
+        unsigned long vertices; ///< Vertices of the polygons of the lights.
+        unsigned long drawCalls; ///< Draw calls made by the LightingAreas.
+        unsigned long pixels; ///< Pixels touched by those draw calls.
+        std::chrono::nanoseconds castTime; ///< Time spent casting.
+        std::chrono::nanoseconds areaTime; ///< Time spent in the LightingAreas.
+
+        /**
+         * @brief Constructor.
+         * @details All the counters start at zero.
+         */
+        Stats();
+
+        /**
+         * @brief Add the counters of another Stats.
+         * @param stats
+         * @returns This Stats.
+         */
+        Stats& operator+=(const Stats& stats);
+
+        /**
+         * @brief Get the global counters.
+         * @returns The sum of the counters of every event since the last
+         * call to @ref reset.
+         */
+        static Stats get();
+
+        /**
+         * @brief Set the global counters to zero.
+         * @returns The counters before the reset.
+         */
+        static Stats reset();
+    };
+
+    /**
+     * @brief Profiled operation, passed to the profile callback.
+     * @see setProfileCallback
+     */
+    struct ProfileEvent{
+        /**
+         * @brief Kinds of profiled operations.
+         */
+        enum Type{
+            CAST_LIGHT, ///< @ref LightSource::castLight.
+            AREA_CLEAR, ///< @ref LightingArea::clear or LightingArea::clearDirty.
+            AREA_DRAW, ///< @ref LightingArea::draw(const LightSource&) or LightingArea::draw(const LightBatch&).
+            AREA_DISPLAY ///< @ref LightingArea::display.
+        };
+        Type type; ///< Kind of operation.
+        const void* object; ///< Light or area that did it.
+        std::chrono::steady_clock::time_point begin; ///< Start of the operation.
+        std::chrono::steady_clock::time_point end; ///< End of the operation.
+        Stats stats; ///< Counters of this operation alone.
+    };
+
+    /**
+     * @brief Function called at the end of each profiled operation.
+     */
+    typedef std::function<void(const ProfileEvent&)> ProfileCallback;
+
+    /**
+     * @brief Set the function to call at the end of each profiled operation.
+     * @details It can forward the events to a profiler, like Tracy, or write
+     * them as a trace. It is called from the thread that did the operation,
+     * which may be a thread of a @ref ThreadPool in
+     * @ref castLights, so it must be thread safe. Each thread keeps a copy
+     * of it, and the threads in the middle of an operation may still call
+     * the last one.
+     * @param callback Function to call, or an empty function to stop.
+     */
+    void setProfileCallback(const ProfileCallback& callback);
+
+    /**
+     * @brief Records an operation while it is in scope.
+     * @details The counters incremented with @ref count from the same thread
+     * are added to the innermost scope. When the scope ends, they are added
+     * to the Stats of the thread and passed to the profile callback.
+     *
+     * Used internally through the `CANDLE_PROFILE_SCOPE` and
+     * `CANDLE_PROFILE_COUNT` macros.
+     */
+    class ProfileScope{
+    private:
+        ProfileEvent m_event;
+        ProfileScope* m_parent;
+
+    public:
+        ProfileScope(ProfileEvent::Type type, const void* object);
+        ~ProfileScope();
+        ProfileScope(const ProfileScope&) = delete;
+        ProfileScope& operator=(const ProfileScope&) = delete;
+
+        /**
+         * @brief Increment a counter of the innermost scope of the thread.
+         * @details Does nothing if there is no scope.
+         * @param counter Member of Stats to increment.
+         * @param n Amount to add.
+         */
+        static void count(unsigned long Stats::*counter, unsigned long n);
+    };
+}
+
+#define CANDLE_PROFILE_SCOPE(type, object) candle::ProfileScope candleProfileScope(candle::ProfileEvent::type, object)
+#define CANDLE_PROFILE_COUNT(counter, n) candle::ProfileScope::count(&candle::Stats::counter, n)
+
+#else
+
+#define CANDLE_PROFILE_SCOPE(type, object)
+#define CANDLE_PROFILE_COUNT(counter, n)
+
+#endif
+
+#endif
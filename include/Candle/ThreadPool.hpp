@@ -0,0 +1,135 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the ThreadPool class and the castLights
+ * functions.
+ */
+#ifndef __CANDLE_THREAD_POOL_HPP__
+#define __CANDLE_THREAD_POOL_HPP__
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "Candle/LightSource.hpp"
+
+namespace candle{
+    /**
+     * @brief Set of threads to run independent tasks in parallel.
+     * @details
+     *
+     * The tasks of a @ref parallelFor are split in equal contiguous ranges,
+     * one for each thread. When a thread finishes its range, it steals half
+     * of the remaining tasks of another one, so the threads are kept busy
+     * even if some tasks take much longer than the others.
+     *
+     * The thread that calls @ref parallelFor works too, so a pool of N
+     * threads only creates N-1 of them. They wait for work between calls.
+     * @see castLights
+     */
+    class ThreadPool{
+    private:
+        struct Range{
+            std::mutex mutex;
+            unsigned int begin;
+            unsigned int end;
+        };
+        std::vector<std::thread> m_threads;
+        std::unique_ptr<Range[]> m_ranges;
+        unsigned int m_slots;
+        std::mutex m_mutex;
+        std::condition_variable m_start;
+        std::condition_variable m_finish;
+        const std::function<void(unsigned int)>* m_task;
+        unsigned long m_generation;
+        unsigned int m_running;
+        bool m_stop;
+
+        bool next(unsigned int slot, unsigned int& task);
+        void work(unsigned int slot);
+        void loop(unsigned int slot);
+
+    public:
+        /**
+         * @brief Constructor.
+         * @param threads Number of threads that run the tasks, including
+         * the one that calls @ref parallelFor. If it is 0, the number of
+         * concurrent threads supported by the system is used.
+         */
+        explicit ThreadPool(unsigned int threads = 0);
+
+        /**
+         * @brief Destructor.
+         * @details Waits for the threads to exit.
+         */
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /**
+         * @brief Get the number of threads that run the tasks.
+         * @returns The number of threads, including the calling one.
+         */
+        unsigned int getThreadCount() const;
+
+        /**
+         * @brief Run a set of independent tasks in parallel.
+         * @details Calls @p task once with each number from 0 to
+         * @p count - 1, distributed among the threads, and returns when all
+         * of them have finished. The tasks must not throw exceptions, nor
+         * call parallelFor on the same pool.
+         * @param count Number of tasks.
+         * @param task Function to run each task.
+         */
+        void parallelFor(unsigned int count, const std::function<void(unsigned int)>& task);
+    };
+
+    /**
+     * @brief Cast a set of lights in parallel.
+     * @details Calls @ref LightSource::castLight on every light, with the
+     * edges in the range, distributing the lights among the threads of
+     * @p pool. Each cast only reads the edges and writes the polygon of its
+     * own light, so the result is exactly the same as casting the lights one
+     * after another, whatever thread casts each one. When the function
+     * returns, the lights are ready to be drawn.
+     *
+     * The edges must not be modified and the lights must not be used
+     * elsewhere while the function runs.
+     * @param lights Container of pointers to the lights (raw or smart), with
+     * size() and operator[], like std::vector.
+     * @param begin Iterator to the first sfu::Line of the vector to take
+     * into account.
+     * @param end Iterator to the first sfu::Line of the vector not to be
+     * taken into account.
+     * @param pool Threads to use.
+     */
+    template <typename LightContainer>
+    void castLights(LightContainer& lights, const EdgeVector::iterator& begin, const EdgeVector::iterator& end, ThreadPool& pool){
+        pool.parallelFor(lights.size(), [&](unsigned int i){
+            lights[i]->castLight(begin, end);
+        });
+    }
+
+    /**
+     * @brief Cast a set of lights in parallel.
+     * @details Same as the version with iterators, with the edges of an
+     * @ref EdgeIndex or an @ref EdgeBuffer.
+     * @param lights Container of pointers to the lights.
+     * @param edges EdgeIndex or EdgeBuffer with the edges to take into
+     * account.
+     * @param pool Threads to use.
+     */
+    template <typename LightContainer, typename Edges>
+    void castLights(LightContainer& lights, const Edges& edges, ThreadPool& pool){
+        pool.parallelFor(lights.size(), [&](unsigned int i){
+            lights[i]->castLight(edges);
+        });
+    }
+}
+
+#endif
@@ -0,0 +1,255 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the TiledLightingArea class.
+ */
+#ifndef __CANDLE_TILED_LIGHTING_AREA_HPP__
+#define __CANDLE_TILED_LIGHTING_AREA_HPP__
+
+#include <map>
+#include <memory>
+#include <utility>
+
+#include "SFML/Graphics.hpp"
+
+#include "Candle/LightingArea.hpp"
+
+namespace candle{
+    /**
+     * @brief LightingArea split in tiles, for areas too big for one texture.
+     * @details
+     *
+     * A @ref LightingArea keeps a sf::RenderTexture as big as the area, so
+     * it can't be bigger than the maximum texture size of the graphics card,
+     * and big areas waste a lot of memory in regions that are not visible.
+     * A TiledLightingArea splits the area in square tiles, each one a
+     * LightingArea of its own, and only keeps the ones around the region
+     * set with @ref setActiveRect or @ref setActiveView.
+     *
+     * The tiles are created the first time they become active. Clearing,
+     * drawing lights, displaying and drawing the area only affect the
+     * active tiles, and a light is only drawn into the tiles that its
+     * bounds overlap. The tiles that are no longer active are kept, with
+     * the lights drawn on them, until there are more than
+     * @ref setMaxInactiveTiles, and then the ones that have been inactive
+     * for longer are destroyed. A destroyed tile starts again from a clear
+     * area if it becomes active later.
+     *
+     * The area only uses a plain color, not a texture.
+     * @see LightingArea
+     */
+    class TiledLightingArea: public sf::Transformable, public sf::Drawable{
+    private:
+        struct Tile{
+            std::unique_ptr<LightingArea> area;
+            bool active;
+            unsigned long lastActive;
+        };
+        typedef std::pair<int, int> TileKey;
+
+        LightingArea::Mode m_mode;
+        sf::Vector2f m_size;
+        unsigned int m_tileSize;
+        unsigned int m_maxInactiveTiles;
+        sf::Color m_color;
+        float m_opacity;
+        float m_resolutionScale;
+        unsigned long m_frame;
+        std::map<TileKey, Tile> m_tiles;
+
+        void draw(sf::RenderTarget& t, sf::RenderStates st) const override;
+        sf::IntRect getTileRange(const sf::FloatRect& rect) const;
+        void placeTile(const TileKey& key, LightingArea& area) const;
+        void evictTiles();
+        template <typename Function>
+        void forEachActiveTile(Function f);
+        template <typename Function>
+        void forEachTile(const sf::FloatRect& rect, bool activeOnly, Function f);
+
+    public:
+        /**
+         * @brief Constructor.
+         * @details Constructs an area with plain color and no active tiles.
+         * @param mode
+         * @param position
+         * @param size
+         * @param tileSize Side of the tiles, in pixels. It is limited to the
+         * maximum texture size of the system.
+         */
+        TiledLightingArea(LightingArea::Mode mode, const sf::Vector2f& position, const sf::Vector2f& size, unsigned int tileSize = 1024);
+
+        /**
+         * @brief Get the local bounding rectangle of the area.
+         * @returns The local bounding rectangle in float.
+         */
+        sf::FloatRect getLocalBounds() const;
+
+        /**
+         * @brief Get the global bounding rectangle of the area.
+         * @returns The global bounding rectangle in float.
+         */
+        sf::FloatRect getGlobalBounds() const;
+
+        /**
+         * @brief Get the side of the tiles.
+         * @returns The side of the tiles, in pixels.
+         */
+        unsigned int getTileSize() const;
+
+        /**
+         * @brief Get the number of tiles that exist, active or not.
+         * @returns The number of tiles.
+         */
+        unsigned int getTileCount() const;
+
+        /**
+         * @brief Set the region of the area that has to be kept.
+         * @details The tiles that overlap @p rect become active, and are
+         * created if they didn't exist. The rest become inactive, and may
+         * be destroyed (see @ref setMaxInactiveTiles).
+         *
+         * Call it before @ref clear, usually with the region that is going
+         * to be drawn.
+         * @param rect Region to keep, in global coordinates.
+         * @see setActiveView
+         */
+        void setActiveRect(const sf::FloatRect& rect);
+
+        /**
+         * @brief Set the region of the area visible in a view as the one
+         * that has to be kept.
+         * @param view View that is going to be used to draw the area.
+         * @see setActiveRect
+         */
+        void setActiveView(const sf::View& view);
+
+        /**
+         * @brief Set how many inactive tiles are kept.
+         * @details When there are more, the ones that have been inactive for
+         * longer are destroyed.
+         *
+         * The default value is 0.
+         * @param count Maximum number of inactive tiles.
+         * @see getMaxInactiveTiles, setActiveRect
+         */
+        void setMaxInactiveTiles(unsigned int count);
+
+        /**
+         * @brief Get how many inactive tiles are kept.
+         * @returns The maximum number of inactive tiles.
+         * @see setMaxInactiveTiles
+         */
+        unsigned int getMaxInactiveTiles() const;
+
+        /**
+         * @brief Set color of the fog/light.
+         * @param color
+         * @see LightingArea::setAreaColor
+         */
+        void setAreaColor(sf::Color color);
+
+        /**
+         * @brief Get color of the fog/light.
+         * @returns The plain color of the fog/light.
+         */
+        sf::Color getAreaColor() const;
+
+        /**
+         * @brief Set the opacity of the fog/light.
+         * @param opacity
+         * @see LightingArea::setAreaOpacity
+         */
+        void setAreaOpacity(float opacity);
+
+        /**
+         * @brief Get the opacity of the fog/light.
+         * @returns The opacity of the fog/light.
+         */
+        float getAreaOpacity() const;
+
+        /**
+         * @brief Set the lighting mode.
+         * @param mode
+         * @see LightingArea::Mode
+         */
+        void setMode(LightingArea::Mode mode);
+
+        /**
+         * @brief Get the lighting mode.
+         * @returns The lighting mode.
+         */
+        LightingArea::Mode getMode() const;
+
+        /**
+         * @brief Set the resolution of the tiles, relative to their size.
+         * @param scale Value greater than 0 and up to 1. Bigger values are
+         * taken as 1, and the rest are ignored.
+         * @see LightingArea::setResolutionScale
+         */
+        void setResolutionScale(float scale);
+
+        /**
+         * @brief Get the resolution of the tiles, relative to their size.
+         * @returns The resolution scale.
+         */
+        float getResolutionScale() const;
+
+        /**
+         * @brief Restore the color of the active tiles.
+         * @see LightingArea::clear
+         */
+        void clear();
+
+        /**
+         * @brief Mark a region to be restored by the next call to
+         * @ref clearDirty.
+         * @details The region is marked in every tile that it overlaps,
+         * active or not, so an inactive tile is restored properly when it
+         * becomes active again.
+         * @param rect Region to restore, in global coordinates.
+         * @see LightingArea::invalidate
+         */
+        void invalidate(const sf::FloatRect& rect);
+
+        /**
+         * @brief Mark the region covered by a light to be restored by the
+         * next call to @ref clearDirty.
+         * @param light
+         * @see LightingArea::invalidate(const LightSource&)
+         */
+        void invalidate(const LightSource& light);
+
+        /**
+         * @brief Restore only the marked regions of the active tiles.
+         * @see LightingArea::clearDirty
+         */
+        void clearDirty();
+
+        /**
+         * @brief In FOG mode, makes visible the area illuminated by the light.
+         * @details The light is only drawn into the active tiles that its
+         * bounds overlap.
+         * @param light
+         * @see LightingArea::draw(const LightSource&)
+         */
+        void draw(const LightSource& light);
+
+        /**
+         * @brief In FOG mode, makes visible the area illuminated by a batch
+         * of lights.
+         * @details The batch is drawn into every active tile.
+         * @param batch
+         * @see LightingArea::draw(const LightBatch&)
+         */
+        void draw(const LightBatch& batch);
+
+        /**
+         * @brief Calls display on the active tiles.
+         * @see LightingArea::display
+         */
+        void display();
+    };
+}
+
+#endif
@@ -0,0 +1,112 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the VertexSink class.
+ */
+#ifndef __CANDLE_VERTEX_SINK_HPP__
+#define __CANDLE_VERTEX_SINK_HPP__
+
+#include <cstddef>
+
+#include "SFML/Graphics/Vertex.hpp"
+
+namespace candle{
+    /**
+     * @brief Buffer of vertices owned by the application, that the lights
+     * write their triangles to.
+     * @details
+     *
+     * The light polygons usually end up in a buffer of the engine, like a
+     * mapped sf::VertexBuffer or a batch of its own. A VertexSink points to
+     * such a buffer, reserved beforehand, and hands out consecutive pieces
+     * of it to @ref LightSource::castLightInto and
+     * @ref LightSource::appendTriangles, so the triangles are written there
+     * directly. The sink never allocates: a light that doesn't fit writes
+     * nothing, and @ref getRequiredSize tells how big the buffer should be
+     * to fit everything.
+     *
+     * @code
+     * std::vector<sf::Vertex> vertices(100000);
+     * candle::VertexSink sink(vertices.data(), vertices.size());
+     * for(auto& light: lights){
+     *     std::size_t offset = light.castLightInto(index, sink);
+     * }
+     * // draw sink.getSize() vertices from sink.getVertices() as sf::Triangles
+     * @endcode
+     *
+     * A sink must not be used from several threads at the same time.
+     */
+    class VertexSink{
+    private:
+        sf::Vertex* m_vertices;
+        std::size_t m_capacity;
+        std::size_t m_size;
+        std::size_t m_required;
+
+    public:
+        /**
+         * @brief Offset returned when the vertices don't fit in the sink.
+         */
+        static const std::size_t FULL = (std::size_t)-1;
+
+        /**
+         * @brief Constructor.
+         * @details Constructs a sink without space.
+         */
+        VertexSink();
+
+        /**
+         * @brief Constructor.
+         * @param vertices Buffer to write to. It is not owned by the sink.
+         * @param capacity Number of vertices of the buffer.
+         */
+        VertexSink(sf::Vertex* vertices, std::size_t capacity);
+
+        /**
+         * @brief Point to another buffer, and empty the sink.
+         * @param vertices Buffer to write to.
+         * @param capacity Number of vertices of the buffer.
+         */
+        void reset(sf::Vertex* vertices, std::size_t capacity);
+
+        /**
+         * @brief Empty the sink, to write again from the start of the buffer.
+         */
+        void clear();
+
+        /**
+         * @brief Take space for some vertices at the end of the sink.
+         * @param count Number of vertices.
+         * @returns The index of the first of them, or FULL if they don't fit.
+         */
+        std::size_t allocate(std::size_t count);
+
+        /**
+         * @brief Get the buffer of the sink.
+         * @returns The buffer given to the sink.
+         */
+        sf::Vertex* getVertices() const;
+
+        /**
+         * @brief Get the number of vertices written.
+         * @returns The size of the used part of the buffer.
+         */
+        std::size_t getSize() const;
+
+        /**
+         * @brief Get the number of vertices of the buffer.
+         * @returns The capacity given to the sink.
+         */
+        std::size_t getCapacity() const;
+
+        /**
+         * @brief Get the size that the buffer should have to fit all the
+         * vertices asked for since the last clear.
+         * @returns The number of vertices, written or not.
+         */
+        std::size_t getRequiredSize() const;
+    };
+}
+
+#endif
@@ -0,0 +1,148 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the functions to query the visibility between
+ * points and the light received by a point.
+ */
+#ifndef __CANDLE_VISIBILITY_HPP__
+#define __CANDLE_VISIBILITY_HPP__
+
+#include <vector>
+
+#include "SFML/System/Vector2.hpp"
+
+#include "Candle/LightSource.hpp"
+#include "Candle/EdgeIndex.hpp"
+#include "Candle/EdgeBuffer.hpp"
+
+namespace candle{
+    /**
+     * @brief Check if an edge blocks the segment between two points.
+     * @details Only the edges between the points are taken into account: an
+     * edge that touches @p to (like the wall on which a point lies) doesn't
+     * hide it. It doesn't need any light nor render target, so it can be
+     * used for the logic of a game, like the line of sight of an enemy.
+     * @param from
+     * @param to
+     * @param begin Iterator to the first sfu::Line of the vector to take
+     * into account.
+     * @param end Iterator to the first sfu::Line of the vector not to be
+     * taken into account.
+     * @returns True if no edge crosses the segment from @p from to @p to.
+     * @see visibleSet, lightAt
+     */
+    bool isVisible(const sf::Vector2f& from, const sf::Vector2f& to, const EdgeVector::iterator& begin, const EdgeVector::iterator& end);
+
+    /**
+     * @brief Check if an edge blocks the segment between two points.
+     * @details Same as the version with iterators, but only the edges in
+     * the cells crossed by the segment are tested.
+     * @param from
+     * @param to
+     * @param edges Index of the edges to take into account.
+     * @returns True if no edge crosses the segment from @p from to @p to.
+     */
+    bool isVisible(const sf::Vector2f& from, const sf::Vector2f& to, const EdgeIndex& edges);
+
+    /**
+     * @brief Check if an edge blocks the segment between two points.
+     * @details Same as the version with iterators, testing several edges at
+     * a time.
+     * @param from
+     * @param to
+     * @param edges Buffer of the edges to take into account.
+     * @returns True if no edge crosses the segment from @p from to @p to.
+     */
+    bool isVisible(const sf::Vector2f& from, const sf::Vector2f& to, const EdgeBuffer& edges);
+
+    /**
+     * @brief Check which points of a set are visible from another one.
+     * @details Equivalent to calling @ref isVisible for each point, but the
+     * edges that can't block any of them are discarded once, before
+     * testing the points.
+     * @param from
+     * @param points Points to check.
+     * @param begin Iterator to the first sfu::Line of the vector to take
+     * into account.
+     * @param end Iterator to the first sfu::Line of the vector not to be
+     * taken into account.
+     * @param visible (Output argument) Indices of the visible points in
+     * @p points, in increasing order. The previous content is discarded.
+     */
+    void visibleSet(const sf::Vector2f& from, const std::vector<sf::Vector2f>& points, const EdgeVector::iterator& begin, const EdgeVector::iterator& end, std::vector<unsigned int>& visible);
+
+    /**
+     * @brief Check which points of a set are visible from another one.
+     * @param from
+     * @param points Points to check.
+     * @param edges Index of the edges to take into account.
+     * @param visible (Output argument) Indices of the visible points in
+     * @p points, in increasing order. The previous content is discarded.
+     */
+    void visibleSet(const sf::Vector2f& from, const std::vector<sf::Vector2f>& points, const EdgeIndex& edges, std::vector<unsigned int>& visible);
+
+    /**
+     * @brief Check which points of a set are visible from another one.
+     * @param from
+     * @param points Points to check.
+     * @param edges Buffer of the edges to take into account.
+     * @param visible (Output argument) Indices of the visible points in
+     * @p points, in increasing order. The previous content is discarded.
+     */
+    void visibleSet(const sf::Vector2f& from, const std::vector<sf::Vector2f>& points, const EdgeBuffer& edges, std::vector<unsigned int>& visible);
+
+    /**
+     * @brief Get the light received by a point.
+     * @details Adds the intensity of every light that reaches @p point
+     * (see @ref LightSource::getIntensityAt) and whose source is visible
+     * from it. The lights don't need to be casted, and nothing is drawn,
+     * so it can be used to know if something is hidden in the shadows.
+     * @param point Point in global coordinates.
+     * @param lights Container of pointers to the lights (raw or smart), with
+     * size() and operator[], like std::vector.
+     * @param begin Iterator to the first sfu::Line of the vector to take
+     * into account.
+     * @param end Iterator to the first sfu::Line of the vector not to be
+     * taken into account.
+     * @returns The sum of the intensities, with the fade applied. It can be
+     * greater than 1.
+     */
+    template <typename LightContainer>
+    float lightAt(const sf::Vector2f& point, const LightContainer& lights, const EdgeVector::iterator& begin, const EdgeVector::iterator& end){
+        float light = 0.f;
+        for(unsigned int i = 0; i < lights.size(); i++){
+            sf::Vector2f source;
+            float intensity = lights[i]->getIntensityAt(point, source);
+            if(intensity > 0.f && isVisible(source, point, begin, end)){
+                light += intensity;
+            }
+        }
+        return light;
+    }
+
+    /**
+     * @brief Get the light received by a point.
+     * @details Same as the version with iterators, with the edges of an
+     * @ref EdgeIndex or an @ref EdgeBuffer.
+     * @param point Point in global coordinates.
+     * @param lights Container of pointers to the lights.
+     * @param edges EdgeIndex or EdgeBuffer with the edges to take into
+     * account.
+     * @returns The sum of the intensities, with the fade applied.
+     */
+    template <typename LightContainer, typename Edges>
+    float lightAt(const sf::Vector2f& point, const LightContainer& lights, const Edges& edges){
+        float light = 0.f;
+        for(unsigned int i = 0; i < lights.size(); i++){
+            sf::Vector2f source;
+            float intensity = lights[i]->getIntensityAt(point, source);
+            if(intensity > 0.f && isVisible(source, point, edges)){
+                light += intensity;
+            }
+        }
+        return light;
+    }
+}
+
+#endif
@@ -0,0 +1,177 @@
+/**
+ * @file
+ * @author Miguel Mejía Jiménez
+ * @copyright MIT License
+ * @brief This file contains the VisibilityGrid class.
+ */
+#ifndef __CANDLE_VISIBILITY_GRID_HPP__
+#define __CANDLE_VISIBILITY_GRID_HPP__
+
+#include <cstdint>
+#include <vector>
+
+#include "SFML/Graphics.hpp"
+
+#include "Candle/LightSource.hpp"
+
+namespace candle{
+    /**
+     * @brief Grid of explored cells, for a persistent fog of war.
+     * @details
+     *
+     * Not clearing a @ref LightingArea keeps what the lights revealed, but
+     * only in a texture, with 4 bytes per pixel, that can't be read by the
+     * CPU cheaply. A VisibilityGrid keeps the same information with 1 bit
+     * per cell, of any size: each call to @ref reveal marks as explored the
+     * cells whose center is illuminated by the light, filling whole spans of
+     * cells at a time, and they stay explored until @ref clear is called.
+     *
+     * The grid can be queried, serialized to be saved or sent through the
+     * network, and converted to a texture, updating only the rows that
+     * changed since the last time.
+     *
+     * @code
+     * candle::VisibilityGrid explored({0, 0}, {256, 256}, 8.f);
+     * sf::Texture exploredTexture;
+     * // ...
+     * light.castLight(edges.begin(), edges.end());
+     * explored.reveal(light);
+     * explored.updateTexture(exploredTexture);
+     * @endcode
+     */
+    class VisibilityGrid{
+    private:
+        typedef std::uint64_t Word;
+
+        sf::Vector2f m_position;
+        sf::Vector2u m_size;
+        float m_cellSize;
+        unsigned int m_wordsPerRow;
+        std::vector<Word> m_words;
+        unsigned int m_dirtyTop;
+        unsigned int m_dirtyBottom;
+        sf::VertexArray m_triangles;
+        std::vector<sf::Uint8> m_rowPixels;
+        sf::Color m_hiddenColor;
+        sf::Color m_exploredColor;
+
+        void fillSpan(unsigned int y, int x0, int x1);
+        void markDirty(unsigned int top, unsigned int bottom);
+
+    public:
+        /**
+         * @brief Constructor.
+         * @details All the cells start unexplored.
+         * @param position Global position of the top-left corner.
+         * @param size Number of columns and rows of cells.
+         * @param cellSize Side of each cell, in global units.
+         */
+        VisibilityGrid(const sf::Vector2f& position, const sf::Vector2u& size, float cellSize);
+
+        /**
+         * @brief Get the global position of the top-left corner.
+         * @returns The position given to the constructor.
+         */
+        const sf::Vector2f& getPosition() const;
+
+        /**
+         * @brief Get the number of columns and rows of cells.
+         * @returns The size of the grid, in cells.
+         */
+        sf::Vector2u getSize() const;
+
+        /**
+         * @brief Get the side of each cell.
+         * @returns The side of a cell, in global units.
+         */
+        float getCellSize() const;
+
+        /**
+         * @brief Get the global bounding rectangle of the grid.
+         * @returns The global bounding rectangle in float.
+         */
+        sf::FloatRect getGlobalBounds() const;
+
+        /**
+         * @brief Mark every cell as unexplored.
+         */
+        void clear();
+
+        /**
+         * @brief Mark as explored the cells illuminated by a light.
+         * @details A cell is illuminated if its center is inside the
+         * polygon of the light and within its reach, like the range of a
+         * RadialLight. How much light it receives doesn't matter.
+         * @param light Light, already casted.
+         */
+        void reveal(const LightSource& light);
+
+        /**
+         * @brief Check if a cell has been explored.
+         * @param x Column of the cell.
+         * @param y Row of the cell.
+         * @returns True if the cell is explored, false if not or if it is out
+         * of the grid.
+         */
+        bool isExplored(unsigned int x, unsigned int y) const;
+
+        /**
+         * @brief Check if a point is in an explored cell.
+         * @param point Point in global coordinates.
+         * @returns True if the cell of the point is explored, false if not
+         * or if it is out of the grid.
+         */
+        bool isExplored(const sf::Vector2f& point) const;
+
+        /**
+         * @brief Get the number of explored cells.
+         * @returns The number of cells marked as explored.
+         */
+        unsigned long getExploredCount() const;
+
+        /**
+         * @brief Write the explored cells to an array of bytes.
+         * @details The array begins with the number of columns and rows, as
+         * 32 bit little-endian integers, followed by the rows of cells, with
+         * 8 cells per byte, from the least significant bit. It is the same
+         * in any platform.
+         * @returns The serialized grid.
+         * @see deserialize
+         */
+        std::vector<sf::Uint8> serialize() const;
+
+        /**
+         * @brief Read the explored cells from an array of bytes.
+         * @details The array must have been written by @ref serialize from
+         * a grid with the same number of columns and rows. Otherwise, the
+         * grid is not modified.
+         * @param data Serialized grid.
+         * @param size Number of bytes of the array.
+         * @returns True if the grid was read.
+         */
+        bool deserialize(const sf::Uint8* data, std::size_t size);
+
+        /**
+         * @brief Check if any cell changed since the last call to
+         * @ref updateTexture.
+         * @returns True if the texture needs to be updated.
+         */
+        bool isDirty() const;
+
+        /**
+         * @brief Update a texture with the explored cells.
+         * @details The texture has one pixel per cell. If it doesn't have
+         * the size of the grid, it is created and updated completely;
+         * otherwise, only the rows that changed since the last call are
+         * uploaded. It can be drawn with a sprite scaled by the cell size,
+         * or used as the texture of a @ref LightingArea. Only one texture
+         * can be kept up to date this way.
+         * @param texture Texture to update.
+         * @param hidden Color of the unexplored cells.
+         * @param explored Color of the explored cells.
+         */
+        void updateTexture(sf::Texture& texture, const sf::Color& hidden = sf::Color::Black, const sf::Color& explored = sf::Color::Transparent);
+    };
+}
+
+#endif
@@ -116,6 +116,81 @@ namespace sfu{
 
     };
 
+    /**
+     * @brief Intersect a segment with a ray.
+     * @details The segment is delimited by @p segment.m_origin and
+     * @p segment.point(1), and the ray goes from @p ray.m_origin in the
+     * direction of @p ray.m_direction.
+     *
+     * The intersection is solved with cross products, without trigonometric
+     * functions or square roots, and with a single division when there is a
+     * hit. Lines forming an angle smaller than 0.001 degrees are considered
+     * parallel and don't intersect.
+     * @param segment
+     * @param ray
+     * @param tSegment (Output argument) If there is a hit, the parameter
+     * required to get the intersection point with @p segment.
+     * @param tRay (Output argument) If there is a hit, the parameter
+     * required to get the intersection point with @p ray.
+     * @returns True if the ray hits the segment.
+     * @see Line::intersection, Line::point
+     */
+    inline bool intersectSegmentRay(const Line& segment, const Line& ray, float& tSegment, float& tRay){
+        const sf::Vector2f& s = segment.m_direction;
+        const sf::Vector2f& r = ray.m_direction;
+        sf::Vector2f d = segment.m_origin - ray.m_origin;
+        float den = r.x*s.y - r.y*s.x;
+        float nRay = d.x*s.y - d.y*s.x;
+        float nSeg = d.x*r.y - d.y*r.x;
+        float sign = den < 0.f ? -1.f : 1.f;
+        den *= sign;
+        nRay *= sign;
+        nSeg *= sign;
+        // A single branch to reject, before dividing
+        bool parallel = den*den <= PARALLEL_EPSILON*PARALLEL_EPSILON * (r.x*r.x + r.y*r.y) * (s.x*s.x + s.y*s.y);
+        if(parallel | (nRay < 0.f) | (nSeg < 0.f) | (nSeg > den)){
+            return false;
+        }
+        tRay = nRay / den;
+        tSegment = nSeg / den;
+        return true;
+    }
+
+    /**
+     * @brief Intersect a segment with a ray.
+     * @param segment
+     * @param ray
+     * @param tRay (Output argument) If there is a hit, the parameter
+     * required to get the intersection point with @p ray.
+     * @returns True if the ray hits the segment.
+     * @see intersectSegmentRay(const Line&, const Line&, float&, float&)
+     */
+    inline bool intersectSegmentRay(const Line& segment, const Line& ray, float& tRay){
+        float tSegment;
+        return intersectSegmentRay(segment, ray, tSegment, tRay);
+    }
+
+    /**
+     * @brief Check if a segment passes within a circle.
+     * @details It compares squared distances, so it is cheaper than
+     * computing the distance from the point to the segment.
+     * @param segment
+     * @param center
+     * @param radius
+     * @returns True if some point of @p segment is at @p radius or less
+     * from @p center.
+     */
+    inline bool segmentInCircle(const Line& segment, const sf::Vector2f& center, float radius){
+        sf::Vector2f d = center - segment.m_origin;
+        const sf::Vector2f& v = segment.m_direction;
+        float vv = v.x*v.x + v.y*v.y;
+        // Parameter of the closest point, clamped to the segment
+        float t = vv > 0.f ? (d.x*v.x + d.y*v.y) / vv : 0.f;
+        t = t < 0.f ? 0.f : (t > 1.f ? 1.f : t);
+        sf::Vector2f p = d - t*v;
+        return p.x*p.x + p.y*p.y <= radius*radius;
+    }
+
     /**
      * @brief Cast a ray against a set of segments.
      * @details Use a line as a ray, casted from its
@@ -141,14 +216,8 @@ namespace sfu{
         float minRange = maxRange;
         ray.m_direction = sfu::normalize(ray.m_direction);
         for(auto it = begin; it != end; it++){
-            float t_seg, t_ray;
-            if(
-                it -> intersection(ray, t_seg, t_ray) == sfu::Line::SECANT
-                && t_ray <= minRange
-                && t_ray >= 0.f
-                && t_seg <= 1.f
-                && t_seg >= 0.f
-            ){
+            float t_ray;
+            if(intersectSegmentRay(*it, ray, t_ray) && t_ray <= minRange){
                 minRange = t_ray;
             }
         }
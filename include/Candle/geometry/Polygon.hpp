@@ -31,9 +31,9 @@ namespace sfu{
         template <typename T>
         void initialize(const sf::Rect<T>& rect){
             sf::Vector2f lt(rect.left, rect.top);
-            sf::Vector2f rt(rect.right, rect.top);
-            sf::Vector2f lb(rect.left, rect.bottom);
-            sf::Vector2f rb(rect.right, rect.bottom);
+            sf::Vector2f rt(rect.left + rect.width, rect.top);
+            sf::Vector2f lb(rect.left, rect.top + rect.height);
+            sf::Vector2f rb(rect.left + rect.width, rect.top + rect.height);
             lines.emplace_back(lt, rt);
             lines.emplace_back(rt, rb);
             lines.emplace_back(rb, lb);
@@ -0,0 +1,136 @@
+#include "Candle/CastPipeline.hpp"
+
+#include <algorithm>
+
+namespace candle{
+    CastJob::CastJob()
+        : m_count(0)
+        , m_remaining(0)
+        {}
+
+    void CastJob::start(unsigned int count, const std::function<void(unsigned int)>& task){
+        m_task = task;
+        m_count = count;
+        m_remaining = count;
+    }
+
+    unsigned int CastJob::getTaskCount() const{
+        return m_count;
+    }
+
+    void CastJob::run(unsigned int i){
+        m_task(i);
+        // Under the lock, so that wait can't check the count right before
+        // it drops to 0 and then miss the notification
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(--m_remaining == 0){
+            m_done.notify_all();
+        }
+    }
+
+    bool CastJob::isDone() const{
+        return m_remaining == 0;
+    }
+
+    void CastJob::wait(){
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [&]{ return m_remaining == 0; });
+    }
+
+    CastPipeline::CastPipeline(ThreadPool* pool)
+        : m_pool(pool)
+        , m_pending(false)
+        , m_stop(false)
+        {
+        if(m_pool){
+            m_thread = std::thread(&CastPipeline::loop, this);
+        }
+    }
+
+    CastPipeline::~CastPipeline(){
+        m_job.wait();
+        if(m_thread.joinable()){
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_start.notify_one();
+            m_thread.join();
+        }
+    }
+
+    void CastPipeline::loop(){
+        std::function<void(unsigned int)> run = [this](unsigned int i){
+            m_job.run(i);
+        };
+        while(true){
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_start.wait(lock, [&]{ return m_stop || m_pending; });
+                if(m_stop){
+                    return;
+                }
+                m_pending = false;
+            }
+            m_pool->parallelFor(m_job.getTaskCount(), run);
+        }
+    }
+
+    CastJob& CastPipeline::start(const std::function<void(unsigned int)>& task){
+        m_job.wait();
+        m_job.start(m_lights.size(), task);
+        if(m_pool && !m_lights.empty()){
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_pending = true;
+            }
+            m_start.notify_one();
+        }
+        return m_job;
+    }
+
+    void CastPipeline::addLight(LightSource* light){
+        m_job.wait();
+        light->setDoubleBuffered(true);
+        m_lights.push_back(light);
+    }
+
+    void CastPipeline::removeLight(LightSource* light){
+        m_job.wait();
+        m_lights.erase(std::remove(m_lights.begin(), m_lights.end(), light), m_lights.end());
+    }
+
+    void CastPipeline::clear(){
+        m_job.wait();
+        m_lights.clear();
+    }
+
+    const std::vector<LightSource*>& CastPipeline::getLights() const{
+        return m_lights;
+    }
+
+    CastJob& CastPipeline::castLights(const EdgeVector::iterator& begin, const EdgeVector::iterator& end){
+        return start([this, begin, end](unsigned int i){
+            m_lights[i]->castLight(begin, end);
+        });
+    }
+
+    CastJob& CastPipeline::castLightsIfNeeded(const EdgeVector::iterator& begin, const EdgeVector::iterator& end, unsigned long edgeVersion){
+        return start([this, begin, end, edgeVersion](unsigned int i){
+            m_lights[i]->castLightIfNeeded(begin, end, edgeVersion);
+        });
+    }
+
+    CastJob& CastPipeline::getJob(){
+        return m_job;
+    }
+
+    unsigned int CastPipeline::swapBuffers(){
+        m_job.wait();
+        unsigned int swapped = 0;
+        for(LightSource* light: m_lights){
+            swapped += light->swapBuffers();
+        }
+        return swapped;
+    }
+}
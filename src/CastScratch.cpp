@@ -0,0 +1,72 @@
+#include "Candle/CastScratch.hpp"
+
+namespace candle{
+    CastScratch::CastScratch()
+#ifdef CANDLE_DEBUG
+        : m_allocations(0)
+#endif
+        {}
+
+    void CastScratch::getCapacities(std::size_t* c) const{
+        c[0] = m_ids.capacity();
+        c[1] = m_angles.capacity();
+        c[2] = m_directions.capacity();
+        c[3] = m_order.capacity();
+        c[4] = m_hitAngles.capacity();
+        c[5] = m_points.capacity();
+        c[6] = m_mergedAngles.capacity();
+        c[7] = m_merged.capacity();
+        c[8] = m_params.capacity();
+        c[9] = m_changes.capacity();
+        c[10] = m_edges.capacity();
+        c[11] = m_occluders.capacity();
+        c[12] = m_window.capacity();
+    }
+
+    void CastScratch::beginCast(){
+#ifdef CANDLE_DEBUG
+        getCapacities(m_capacities);
+#endif
+    }
+
+    void CastScratch::endCast(){
+#ifdef CANDLE_DEBUG
+        std::size_t capacities[BUFFERS];
+        getCapacities(capacities);
+        for(unsigned int i = 0; i < BUFFERS; i++){
+            if(capacities[i] > m_capacities[i]){
+                m_allocations++;
+            }
+        }
+#endif
+    }
+
+    void CastScratch::release(){
+        std::vector<unsigned int>().swap(m_ids);
+        std::vector<float>().swap(m_angles);
+        std::vector<sf::Vector2f>().swap(m_directions);
+        std::vector<unsigned int>().swap(m_order);
+        std::vector<float>().swap(m_hitAngles);
+        std::vector<sf::Vector2f>().swap(m_points);
+        std::vector<float>().swap(m_mergedAngles);
+        std::vector<sf::Vector2f>().swap(m_merged);
+        std::vector<float>().swap(m_params);
+        std::vector<EdgeChange>().swap(m_changes);
+        std::vector<sfu::Line>().swap(m_edges);
+        std::vector<unsigned int>().swap(m_occluders);
+        std::vector<AngleRange>().swap(m_window);
+    }
+
+    unsigned long CastScratch::getAllocationCount() const{
+#ifdef CANDLE_DEBUG
+        return m_allocations;
+#else
+        return 0;
+#endif
+    }
+
+    CastScratch& CastScratch::getThreadScratch(){
+        static thread_local CastScratch s_scratch;
+        return s_scratch;
+    }
+}
@@ -2,4 +2,5 @@
 
 namespace sfu{
     const float PI = 3.1415926f;
+    const float PARALLEL_EPSILON = 1.7453292e-5f;
 }
@@ -1,18 +1,46 @@
 #include "Candle/DirectedLight.hpp"
 
-#include <queue>
+#include <algorithm>
 
+#include "Candle/EdgeIndex.hpp"
+#include "Candle/EdgeBuffer.hpp"
+#include "Candle/EdgeMesh.hpp"
+#include "Candle/Occluder.hpp"
+#include "Candle/CastScratch.hpp"
+#include "Candle/Stats.hpp"
 #include "Candle/geometry/Vector2.hpp"
 #include "Candle/geometry/Line.hpp"
 #include "Candle/graphics/VertexArray.hpp"
 
 namespace candle{
+    namespace{
+        // Visits the edges given by get(0) to get(count - 1), as the
+        // EdgeVisitor of castLightImpl, so that it can be inlined
+        template <typename EdgeGetter>
+        struct EdgeList{
+            unsigned int count;
+            EdgeGetter get;
+
+            template <typename EdgeFunction>
+            void operator()(const EdgeFunction& f) const{
+                for(unsigned int i = 0; i < count; i++){
+                    f(get(i));
+                }
+            }
+        };
+
+        template <typename EdgeGetter>
+        EdgeList<EdgeGetter> edgeList(unsigned int count, const EdgeGetter& get){
+            return EdgeList<EdgeGetter>{count, get};
+        }
+    }
+
     void DirectedLight::draw(sf::RenderTarget& t, sf::RenderStates st) const{
-        st.transform *= Transformable::getTransform();
+        st.transform *= getFrontTransform();
         if(st.blendMode == sf::BlendAlpha){ // the default
             st.blendMode = sf::BlendAdd;
         }
-        t.draw(m_polygon, st);
+        drawPolygon(t, st);
 #ifdef CANDLE_DEBUG
         sf::RenderStates deb_s;
         deb_s.transform = st.transform;
@@ -21,24 +49,22 @@ namespace candle{
     }
     
     void DirectedLight::resetColor(){
-        int quads = m_polygon.getVertexCount() / 4;
-        for(int i = 0; i < quads; i++){
-            float p1 = i*4;
-            float p2 = p1+1;
-            float p3 = p1+2;
-            float p4 = p1+3;
-            sf::Vector2f r1 = m_polygon[p1].position;
-            sf::Vector2f r2 = m_polygon[p2].position;
-            sf::Vector2f r3 = m_polygon[p4].position;
-            sf::Vector2f r4 = m_polygon[p3].position;
-            
-            float dr1 = 1.f - m_fade * (sfu::magnitude(r2-r1) / m_range);
-            float dr2 = 1.f - m_fade * (sfu::magnitude(r4-r3) / m_range);
-            m_polygon[p1].color = m_polygon[p2].color =
-                m_polygon[p3].color = m_polygon[p4].color = m_color;
-            m_polygon[p2].color.a = m_color.a * dr1;
-            m_polygon[p3].color.a = m_color.a * dr2;
+        sf::VertexArray& polygon = getLatestPolygon();
+        unsigned int quads = polygon.getVertexCount() / 4;
+        for(unsigned int i = 0; i < quads && i + 1 < m_rayLengths.size(); i++){
+            setQuadColor(polygon, i);
         }
+        latestPolygonChanged();
+    }
+    
+    void DirectedLight::setQuadColor(sf::VertexArray& polygon, unsigned int i) const{
+        // The quad goes from the ray i to the ray i+1, and fades along them
+        float dr1 = 1.f - m_fade * (m_rayLengths[i] / m_range);
+        float dr2 = 1.f - m_fade * (m_rayLengths[i+1] / m_range);
+        polygon[i*4].color = polygon[i*4+1].color =
+            polygon[i*4+2].color = polygon[i*4+3].color = m_color;
+        polygon[i*4+1].color.a = m_color.a * dr1;
+        polygon[i*4+2].color.a = m_color.a * dr2;
     }
     
     DirectedLight::DirectedLight(){
@@ -50,25 +76,141 @@ namespace candle{
     
     void DirectedLight::setBeamWidth(float width){
         m_beamWidth = width;
+        m_castDirty = true;
     }
     
     float DirectedLight::getBeamWidth() const{
         return m_beamWidth;
     }
     
-    struct LineParam: public sfu::Line{
-        float param;
-        LineParam(float f, const sfu::Line& l)
-            : sfu::Line(l)
-            , param(f) { }
-        LineParam(const sf::Vector2f& orig, const sf::Vector2f& dir, float p)
-            : sfu::Line(orig, orig + dir)
-            , param(p) { }
-    };
-    bool operator < (const LineParam& a, const LineParam& b){
-        return a.param < b.param;
+    sf::FloatRect DirectedLight::getGlobalBounds() const{
+        return getFrontTransform().transformRect(getFrontPolygon().getBounds());
+    }
+    
+    float DirectedLight::getIntensityAt(const sf::Vector2f& point, sf::Vector2f& source) const{
+        // In local coordinates, the beam goes along the x axis
+        sf::Vector2f local = Transformable::getInverseTransform().transformPoint(point);
+        float widthHalf = m_beamWidth/2.f;
+        if(local.x < 0.f || local.x > m_range || local.y < -widthHalf || local.y > widthHalf){
+            return 0.f;
+        }
+        source = Transformable::getTransform().transformPoint(0.f, local.y);
+        return getIntensity() * (1.f - m_fade * (local.x / m_range));
     }
+    
     void DirectedLight::castLight(const EdgeVector::iterator& begin, const EdgeVector::iterator& end){
+        castLightRange(begin, end);
+    }
+    
+    void DirectedLight::castLight(const EdgeMesh& mesh){
+        // Same as with a vector, since the rays are parallel and they are
+        // not casted past the ends of the edges
+        castLightRange(mesh.getEdges().begin(), mesh.getEdges().end());
+    }
+    
+    template <typename Iterator>
+    void DirectedLight::castLightRange(const Iterator& begin, const Iterator& end){
+        CANDLE_PROFILE_SCOPE(CAST_LIGHT, this);
+        CastScratch& scratch = castScratch();
+        scratch.beginCast();
+        // Drop the edges with both ends on the same side out of the beam,
+        // in the local coordinates of the light, where it is a rectangle
+        std::vector<sfu::Line>& edges = scratch.m_edges;
+        edges.clear();
+        sf::Transform trm_i = Transformable::getInverseTransform();
+        float widthHalf = m_beamWidth/2.f;
+        auto outside = [&](const sf::Vector2f& p){
+            sf::Vector2f l = trm_i.transformPoint(p);
+            return (l.x < 0.f) | (l.x > m_range) << 1 | (l.y < -widthHalf) << 2 | (l.y > widthHalf) << 3;
+        };
+        for(auto it = begin; it != end; it++){
+            if(!(outside(it->m_origin) & outside(it->point(1.f)))){
+                edges.push_back(*it);
+            }
+        }
+        CANDLE_PROFILE_COUNT(edges, end - begin);
+        CANDLE_PROFILE_COUNT(culledEdges, (end - begin) - edges.size());
+        castLightImpl(
+            edgeList(edges.size(), [&](unsigned int i)-> const sfu::Line& {
+                return edges[i];
+            }),
+            [&](const sfu::Line& r){
+                CANDLE_PROFILE_COUNT(intersectionTests, edges.size());
+                return sfu::castRay(edges.begin(), edges.end(), r, m_range);
+            });
+        scratch.endCast();
+    }
+    
+    std::size_t DirectedLight::countTriangleVertices(const sf::VertexArray& polygon) const{
+        return polygon.getVertexCount() / 4 * 6;
+    }
+    
+    void DirectedLight::writeTriangles(const sf::VertexArray& polygon, const sf::Transform& transform, sf::Vertex* triangles) const{
+        // Each quad is split in two triangles by its diagonal 0-2
+        unsigned int quads = polygon.getVertexCount() / 4;
+        for(unsigned int i = 0; i < quads; i++){
+            const unsigned int corners[] = {0, 1, 2, 0, 2, 3};
+            for(unsigned int c: corners){
+                sf::Vertex v = polygon[i*4 + c];
+                v.position = transform.transformPoint(v.position);
+                *triangles++ = v;
+            }
+        }
+    }
+    
+    sf::FloatRect DirectedLight::getBeamBounds() const{
+        float widthHalf = m_beamWidth/2.f;
+        return Transformable::getTransform().transformRect(
+            sf::FloatRect(0, -widthHalf, m_range, m_beamWidth));
+    }
+    
+    void DirectedLight::castLight(const EdgeIndex& index){
+        CANDLE_PROFILE_SCOPE(CAST_LIGHT, this);
+        CastScratch& scratch = castScratch();
+        scratch.beginCast();
+        std::vector<unsigned int>& ids = scratch.m_ids;
+        index.query(getBeamBounds(), ids);
+        CANDLE_PROFILE_COUNT(edges, ids.size());
+        const EdgeVector& edges = index.getEdges();
+        castLightImpl(
+            edgeList(ids.size(), [&](unsigned int i)-> const sfu::Line& {
+                return edges[ids[i]];
+            }),
+            [&](const sfu::Line& r){
+                return index.castRay(r, m_range);
+            });
+        scratch.endCast();
+    }
+    
+    bool DirectedLight::castLightChanges(const EdgeIndex& index, const std::vector<EdgeChange>& changes){
+        sf::FloatRect beamBounds = getBeamBounds();
+        for(auto& c: changes){
+            if(beamBounds.intersects(c.before.getGlobalBounds()) || beamBounds.intersects(c.after.getGlobalBounds())){
+                castLight(index);
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    void DirectedLight::castLight(const EdgeBuffer& edges){
+        CANDLE_PROFILE_SCOPE(CAST_LIGHT, this);
+        CastScratch& scratch = castScratch();
+        scratch.beginCast();
+        CANDLE_PROFILE_COUNT(edges, edges.size());
+        castLightImpl(
+            edgeList(edges.size(), [&](unsigned int i){
+                return edges.getEdge(i);
+            }),
+            [&](const sfu::Line& r){
+                CANDLE_PROFILE_COUNT(intersectionTests, edges.size());
+                return candle::castRay(edges, r, m_range);
+            });
+        scratch.endCast();
+    }
+    
+    template <typename EdgeVisitor, typename RayCaster>
+    void DirectedLight::castLightImpl(const EdgeVisitor& forEachEdge, const RayCaster& caster){
         sf::Transform trm = Transformable::getTransform();
         sf::Transform trm_i = trm.getInverse();
         
@@ -80,48 +222,113 @@ namespace candle{
         sf::Vector2f lim2o = trm.transformPoint(0, widthHalf);
         sf::Vector2f lim2d = trm.transformPoint(m_range, widthHalf);
         
-        float off = 0.01/sfu::magnitude(lim2o - lim1o);
+        float width = sfu::magnitude(lim2o - lim1o);
+        float off = 0.01/width;
+        // With a level of detail, the short edges are skipped, and with a
+        // coarse one, rays closer than this parameter are merged
+        bool lod = m_lodTolerance > 0.f;
+        bool coarse = isCoarseLod(std::max(width, m_range));
+        float lodParam = m_lodTolerance / width;
         sf::Vector2f lightDir = lim1d - lim1o;
         
-        sfu::Line lim1(lim1o, lim1d);
-        sfu::Line lim2(lim2o, lim2d);
         sfu::Line raySrc(lim1o, lim2o);
         sfu::Line rayRng(lim1d, lim2d);
         
-        std::priority_queue <LineParam> rays;
+        // Each ray is stored as its parameter along raySrc, since all of
+        // them have the same direction
+        CastScratch& scratch = castScratch();
+        std::vector<float>& rays = scratch.m_params;
+        rays.clear();
+        auto addRay = [&rays](float t){
+            rays.push_back(t);
+        };
         
-        rays.emplace(0.f, lim1);
-        rays.emplace(1.f, lim2);
-        for(auto it = begin; it != end; it++){
-            auto& seg = *it;
+        addRay(0.f);
+        addRay(1.f);
+        auto visit = [&](const sfu::Line& seg){
+            if(lod && sfu::magnitude(seg.m_direction) < m_lodTolerance){
+                return;
+            }
             float tRng, tSeg;
-            if(
-                rayRng.intersection(seg, tRng, tSeg) == sfu::Line::SECANT
-                && tRng <= 1
-                && tRng >= 0
-                && tSeg <= 1
-                && tSeg >= 0
-            ){
-                rays.emplace(raySrc.point(tRng), lightDir, tRng);
+            CANDLE_PROFILE_COUNT(intersectionTests, 1);
+            if(sfu::intersectSegmentRay(rayRng, seg, tRng, tSeg) && tSeg <= 1){
+                addRay(tRng);
             }
             float t;
             sf::Vector2f end = seg.m_origin;
             if(baseBeam.contains(trm_i.transformPoint(end))){
                 raySrc.intersection(sfu::Line(end, end-lightDir), t);
-                rays.emplace(raySrc.point(t - off), lightDir, t - off);
-                rays.emplace(raySrc.point(t), lightDir, t);
-                rays.emplace(raySrc.point(t + off), lightDir, t + off);
+                addRay(t);
+                if(!coarse){
+                    addRay(t - off);
+                    addRay(t + off);
+                }
             }
             end = seg.point(1.f);
             if(baseBeam.contains(trm_i.transformPoint(end))){
                 raySrc.intersection(sfu::Line(end, end-lightDir), t);
-                rays.emplace(raySrc.point(t - off), lightDir, t - off);
-                rays.emplace(raySrc.point(t), lightDir, t);
-                rays.emplace(raySrc.point(t + off), lightDir, t + off);
+                addRay(t);
+                if(!coarse){
+                    addRay(t - off);
+                    addRay(t + off);
+                }
+            }
+        };
+        forEachEdge(visit);
+
+        // The occluders add the rays around the points of their silhouettes,
+        // and are tested after the edges by every ray
+        std::vector<unsigned int>& occluders = scratch.m_occluders;
+        occluders.clear();
+        if(m_occluders){
+            m_occluders->query(getBeamBounds(), nullptr, occluders);
+        }
+        if(!occluders.empty()){
+            // The rays just before a point have a smaller parameter if the
+            // parameters grow to the left of the light
+            sf::Vector2f across = lim2o - lim1o;
+            bool increasing = lightDir.x * across.y - lightDir.y * across.x > 0.f;
+            auto addPoint = [&](const sf::Vector2f& p, int flags){
+                float t;
+                raySrc.intersection(sfu::Line(p, p - lightDir), t);
+                if(t < 0.f || t > 1.f){
+                    return;
+                }
+                if(coarse || (flags & 2)){
+                    addRay(t);
+                }
+                if(!coarse){
+                    if(flags & (increasing ? 1 : 4)){
+                        addRay(t - off);
+                    }
+                    if(flags & (increasing ? 4 : 1)){
+                        addRay(t + off);
+                    }
+                }
+            };
+            m_occluders->visitVertices(occluders, lightDir, true, m_lodTolerance, addPoint);
+        }
+        auto cast = [&](const sfu::Line& r){
+            sf::Vector2f p = caster(r);
+            float distance = sfu::magnitude(p - r.m_origin);
+            if(!occluders.empty() && m_occluders->castRay(occluders, r, distance)){
+                p = r.m_origin + distance * sfu::normalize(r.m_direction);
+            }
+            return p;
+        };
+        std::sort(rays.begin(), rays.end(), std::greater<float>());
+        if(coarse){
+            // Keep the limits, 1 first and 0 last, and drop the rays too
+            // close to the last one kept
+            unsigned int kept = 1;
+            for(unsigned int i = 1; i + 1 < rays.size(); i++){
+                if(rays[kept-1] - rays[i] >= lodParam && rays[i] - rays.back() >= lodParam){
+                    rays[kept++] = rays[i];
+                }
             }
+            rays[kept++] = rays.back();
+            rays.resize(kept);
         }
-        std::vector<sf::Vector2f> points;
-        points.reserve(rays.size()*2);
 #ifdef CANDLE_DEBUG
         int deb_r = rays.size()*2 + 4;
         m_debug.resize(deb_r);
@@ -134,39 +341,35 @@ namespace candle{
         m_debug[deb_r-3].position = {m_range, -widthHalf};
         m_debug[deb_r-4].position = {m_range, widthHalf};
 #endif
-        while(!rays.empty()){
-            LineParam r = rays.top();
+        // Cast the rays in order and emit the quad between each one and the
+        // previous one as soon as it is known
+        unsigned int n = rays.size();
+        m_polygon.resize((n - 1) * 4); // there are always the two limits
+        CANDLE_PROFILE_COUNT(rays, n);
+        CANDLE_PROFILE_COUNT(vertices, m_polygon.getVertexCount());
+        m_rayLengths.resize(n);
+        for(unsigned int k = 0; k < n; k++){
+            sf::Vector2f origin = raySrc.point(rays[k]);
+            sfu::Line r(origin, origin + lightDir);
         
             sf::Vector2f p1 = trm_i.transformPoint(r.m_origin);
-            sf::Vector2f p2 = trm_i.transformPoint(sfu::castRay(begin, end, r, m_range));
-            points.push_back(p1);
-            points.push_back(p2);
+            sf::Vector2f p2 = trm_i.transformPoint(cast(r));
+            m_rayLengths[k] = sfu::magnitude(p2 - p1);
 #ifdef CANDLE_DEBUG
             m_debug[i++].position = p1;
             m_debug[i++].position = p2;
 #endif
-            rays.pop();
-        }
-        if(!points.empty()){
-            int quads = points.size()/2-1; // a quad between every two rays
-            m_polygon.resize(quads * 4);
-            for(int i = 0; i < quads; i++){
-                float p1 = i*4,  r1 = i*2;
-                float p2 = p1+1, r2 = r1+1;
-                float p3 = p1+2, r3 = r1+2;
-                float p4 = p1+3, r4 = r1+3;
-                m_polygon[p1].position = points[r1];
-                m_polygon[p2].position = points[r2];
-                m_polygon[p3].position = points[r4];
-                m_polygon[p4].position = points[r3];
-                
-                float dr1 = 1.f - m_fade * (sfu::magnitude(points[r2]-points[r1]) / m_range);
-                float dr2 = 1.f - m_fade * (sfu::magnitude(points[r4]-points[r3]) / m_range);
-                m_polygon[p1].color = m_polygon[p4].color = m_color;
-                m_polygon[p2].color = m_polygon[p3].color = m_color;
-                m_polygon[p2].color.a = m_color.a * dr1;
-                m_polygon[p3].color.a = m_color.a * dr2;
-            }  
+            if(k > 0){
+                m_polygon[k*4-2].position = p2;
+                m_polygon[k*4-1].position = p1;
+                setQuadColor(m_polygon, k-1);
+            }
+            if(k + 1 < n){
+                m_polygon[k*4].position = p1;
+                m_polygon[k*4+1].position = p2;
+            }
         }
+        m_castDirty = true;
+        m_bufferDirty = true;
     }
 }
@@ -0,0 +1,212 @@
+#include "Candle/EdgeBuffer.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+#include "Candle/geometry/Vector2.hpp"
+
+#if !defined(CANDLE_NO_SIMD)
+    #if defined(__AVX__)
+        #define CANDLE_EDGE_BUFFER_AVX
+        #include <immintrin.h>
+    #elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define CANDLE_EDGE_BUFFER_SSE
+        #include <emmintrin.h>
+    #elif defined(__ARM_NEON) && defined(__aarch64__)
+        #define CANDLE_EDGE_BUFFER_NEON
+        #include <arm_neon.h>
+    #endif
+#endif
+
+namespace candle{
+    // The arrays are padded up to a multiple of the widest vector with
+    // edges of length 0, that are parallel to every ray and never hit.
+    const unsigned int PADDING = 8;
+
+    EdgeBuffer::EdgeBuffer()
+        : m_size(0)
+        , m_version(newEdgeVersion())
+        {}
+
+    EdgeBuffer::EdgeBuffer(const EdgeVector::iterator& begin, const EdgeVector::iterator& end)
+        : m_size(0)
+        {
+        build(begin, end);
+    }
+
+    void EdgeBuffer::build(const EdgeVector::iterator& begin, const EdgeVector::iterator& end){
+        m_size = end - begin;
+        m_version = newEdgeVersion();
+        unsigned int padded = (m_size + PADDING - 1) / PADDING * PADDING;
+        m_x.assign(padded, 0.f);
+        m_y.assign(padded, 0.f);
+        m_dx.assign(padded, 0.f);
+        m_dy.assign(padded, 0.f);
+        unsigned int i = 0;
+        for(auto it = begin; it != end; it++, i++){
+            m_x[i] = it->m_origin.x;
+            m_y[i] = it->m_origin.y;
+            m_dx[i] = it->m_direction.x;
+            m_dy[i] = it->m_direction.y;
+        }
+    }
+
+    unsigned int EdgeBuffer::size() const{
+        return m_size;
+    }
+
+    sfu::Line EdgeBuffer::getEdge(unsigned int i) const{
+        sf::Vector2f origin(m_x[i], m_y[i]);
+        sfu::Line edge(origin, origin);
+        edge.m_direction = sf::Vector2f(m_dx[i], m_dy[i]);
+        return edge;
+    }
+
+    unsigned long EdgeBuffer::getVersion() const{
+        return m_version;
+    }
+
+    // Each kernel computes, for every edge, the same as
+    // sfu::intersectSegmentRay, and keeps the smallest distance.
+    float castRayDistance(const EdgeBuffer& edges, const sfu::Line& ray, float maxRange){
+        sf::Vector2f r = sfu::normalize(ray.m_direction);
+        const float ox = ray.m_origin.x;
+        const float oy = ray.m_origin.y;
+        const float eps = sfu::PARALLEL_EPSILON*sfu::PARALLEL_EPSILON * (r.x*r.x + r.y*r.y);
+        const unsigned int n = edges.m_x.size();
+        const float* X = edges.m_x.data();
+        const float* Y = edges.m_y.data();
+        const float* DX = edges.m_dx.data();
+        const float* DY = edges.m_dy.data();
+        float best = maxRange;
+        unsigned int i = 0;
+
+#if defined(CANDLE_EDGE_BUFFER_AVX)
+        const __m256 vox = _mm256_set1_ps(ox);
+        const __m256 voy = _mm256_set1_ps(oy);
+        const __m256 vrx = _mm256_set1_ps(r.x);
+        const __m256 vry = _mm256_set1_ps(r.y);
+        const __m256 veps = _mm256_set1_ps(eps);
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 signMask = _mm256_set1_ps(-0.f);
+        __m256 vbest = _mm256_set1_ps(maxRange);
+        for(; i < n; i += 8){
+            __m256 sx = _mm256_loadu_ps(DX + i);
+            __m256 sy = _mm256_loadu_ps(DY + i);
+            __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(X + i), vox);
+            __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(Y + i), voy);
+            __m256 den = _mm256_sub_ps(_mm256_mul_ps(vrx, sy), _mm256_mul_ps(vry, sx));
+            __m256 nRay = _mm256_sub_ps(_mm256_mul_ps(dx, sy), _mm256_mul_ps(dy, sx));
+            __m256 nSeg = _mm256_sub_ps(_mm256_mul_ps(dx, vry), _mm256_mul_ps(dy, vrx));
+            __m256 sign = _mm256_and_ps(den, signMask);
+            den = _mm256_xor_ps(den, sign);
+            nRay = _mm256_xor_ps(nRay, sign);
+            nSeg = _mm256_xor_ps(nSeg, sign);
+            __m256 ss = _mm256_add_ps(_mm256_mul_ps(sx, sx), _mm256_mul_ps(sy, sy));
+            __m256 hit = _mm256_cmp_ps(_mm256_mul_ps(den, den), _mm256_mul_ps(veps, ss), _CMP_GT_OQ);
+            hit = _mm256_and_ps(hit, _mm256_cmp_ps(nRay, zero, _CMP_GE_OQ));
+            hit = _mm256_and_ps(hit, _mm256_cmp_ps(nSeg, zero, _CMP_GE_OQ));
+            hit = _mm256_and_ps(hit, _mm256_cmp_ps(nSeg, den, _CMP_LE_OQ));
+            __m256 t = _mm256_div_ps(nRay, den);
+            vbest = _mm256_blendv_ps(vbest, _mm256_min_ps(vbest, t), hit);
+        }
+        __m128 v4 = _mm_min_ps(_mm256_castps256_ps128(vbest), _mm256_extractf128_ps(vbest, 1));
+        v4 = _mm_min_ps(v4, _mm_movehl_ps(v4, v4));
+        v4 = _mm_min_ss(v4, _mm_shuffle_ps(v4, v4, 1));
+        best = _mm_cvtss_f32(v4);
+#elif defined(CANDLE_EDGE_BUFFER_SSE)
+        const __m128 vox = _mm_set1_ps(ox);
+        const __m128 voy = _mm_set1_ps(oy);
+        const __m128 vrx = _mm_set1_ps(r.x);
+        const __m128 vry = _mm_set1_ps(r.y);
+        const __m128 veps = _mm_set1_ps(eps);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 signMask = _mm_set1_ps(-0.f);
+        __m128 vbest = _mm_set1_ps(maxRange);
+        for(; i < n; i += 4){
+            __m128 sx = _mm_loadu_ps(DX + i);
+            __m128 sy = _mm_loadu_ps(DY + i);
+            __m128 dx = _mm_sub_ps(_mm_loadu_ps(X + i), vox);
+            __m128 dy = _mm_sub_ps(_mm_loadu_ps(Y + i), voy);
+            __m128 den = _mm_sub_ps(_mm_mul_ps(vrx, sy), _mm_mul_ps(vry, sx));
+            __m128 nRay = _mm_sub_ps(_mm_mul_ps(dx, sy), _mm_mul_ps(dy, sx));
+            __m128 nSeg = _mm_sub_ps(_mm_mul_ps(dx, vry), _mm_mul_ps(dy, vrx));
+            __m128 sign = _mm_and_ps(den, signMask);
+            den = _mm_xor_ps(den, sign);
+            nRay = _mm_xor_ps(nRay, sign);
+            nSeg = _mm_xor_ps(nSeg, sign);
+            __m128 ss = _mm_add_ps(_mm_mul_ps(sx, sx), _mm_mul_ps(sy, sy));
+            __m128 hit = _mm_cmpgt_ps(_mm_mul_ps(den, den), _mm_mul_ps(veps, ss));
+            hit = _mm_and_ps(hit, _mm_cmpge_ps(nRay, zero));
+            hit = _mm_and_ps(hit, _mm_cmpge_ps(nSeg, zero));
+            hit = _mm_and_ps(hit, _mm_cmple_ps(nSeg, den));
+            __m128 t = _mm_div_ps(nRay, den);
+            __m128 closer = _mm_min_ps(vbest, t);
+            vbest = _mm_or_ps(_mm_and_ps(hit, closer), _mm_andnot_ps(hit, vbest));
+        }
+        vbest = _mm_min_ps(vbest, _mm_movehl_ps(vbest, vbest));
+        vbest = _mm_min_ss(vbest, _mm_shuffle_ps(vbest, vbest, 1));
+        best = _mm_cvtss_f32(vbest);
+#elif defined(CANDLE_EDGE_BUFFER_NEON)
+        const float32x4_t vox = vdupq_n_f32(ox);
+        const float32x4_t voy = vdupq_n_f32(oy);
+        const float32x4_t vrx = vdupq_n_f32(r.x);
+        const float32x4_t vry = vdupq_n_f32(r.y);
+        const float32x4_t veps = vdupq_n_f32(eps);
+        const float32x4_t zero = vdupq_n_f32(0.f);
+        float32x4_t vbest = vdupq_n_f32(maxRange);
+        for(; i < n; i += 4){
+            float32x4_t sx = vld1q_f32(DX + i);
+            float32x4_t sy = vld1q_f32(DY + i);
+            float32x4_t dx = vsubq_f32(vld1q_f32(X + i), vox);
+            float32x4_t dy = vsubq_f32(vld1q_f32(Y + i), voy);
+            float32x4_t den = vsubq_f32(vmulq_f32(vrx, sy), vmulq_f32(vry, sx));
+            float32x4_t nRay = vsubq_f32(vmulq_f32(dx, sy), vmulq_f32(dy, sx));
+            float32x4_t nSeg = vsubq_f32(vmulq_f32(dx, vry), vmulq_f32(dy, vrx));
+            uint32x4_t negative = vcltq_f32(den, zero);
+            den = vabsq_f32(den);
+            nRay = vbslq_f32(negative, vnegq_f32(nRay), nRay);
+            nSeg = vbslq_f32(negative, vnegq_f32(nSeg), nSeg);
+            float32x4_t ss = vaddq_f32(vmulq_f32(sx, sx), vmulq_f32(sy, sy));
+            uint32x4_t hit = vcgtq_f32(vmulq_f32(den, den), vmulq_f32(veps, ss));
+            hit = vandq_u32(hit, vcgeq_f32(nRay, zero));
+            hit = vandq_u32(hit, vcgeq_f32(nSeg, zero));
+            hit = vandq_u32(hit, vcleq_f32(nSeg, den));
+            float32x4_t t = vdivq_f32(nRay, den);
+            vbest = vbslq_f32(hit, vminq_f32(vbest, t), vbest);
+        }
+        best = vminvq_f32(vbest);
+#endif
+
+        for(; i < n; i++){
+            float sx = DX[i];
+            float sy = DY[i];
+            float dx = X[i] - ox;
+            float dy = Y[i] - oy;
+            float den = r.x*sy - r.y*sx;
+            float nRay = dx*sy - dy*sx;
+            float nSeg = dx*r.y - dy*r.x;
+            float sign = den < 0.f ? -1.f : 1.f;
+            den *= sign;
+            nRay *= sign;
+            nSeg *= sign;
+            bool hit = (den*den > eps * (sx*sx + sy*sy)) & (nRay >= 0.f) & (nSeg >= 0.f) & (nSeg <= den);
+            if(hit){
+                best = std::min(best, nRay / den);
+            }
+        }
+        return best;
+    }
+
+    sf::Vector2f castRay(const EdgeBuffer& edges, const sfu::Line& ray, float maxRange){
+        float t = castRayDistance(edges, ray, maxRange);
+        return ray.m_origin + t * sfu::normalize(ray.m_direction);
+    }
+
+    void castRays(const EdgeBuffer& edges, const std::vector<sfu::Line>& rays, std::vector<sf::Vector2f>& out, float maxRange){
+        out.resize(rays.size());
+        for(unsigned int i = 0; i < rays.size(); i++){
+            out[i] = castRay(edges, rays[i], maxRange);
+        }
+    }
+}
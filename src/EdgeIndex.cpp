@@ -0,0 +1,287 @@
+#include "Candle/EdgeIndex.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+#include "Candle/Stats.hpp"
+#include "Candle/geometry/Vector2.hpp"
+
+namespace candle{
+    // Number of changes remembered for getChanges
+    const unsigned int MAX_CHANGES = 1024;
+
+    EdgeIndex::EdgeIndex(float cellSize)
+        : m_cellSize(cellSize)
+        , m_cols(0)
+        , m_rows(0)
+        , m_version(newEdgeVersion())
+        , m_baseVersion(m_version)
+        {}
+
+    EdgeIndex::EdgeIndex(const EdgeVector::iterator& begin, const EdgeVector::iterator& end, float cellSize)
+        : m_cellSize(cellSize)
+        , m_cols(0)
+        , m_rows(0)
+        {
+        build(begin, end);
+    }
+
+    int EdgeIndex::cellX(float x) const{
+        int c = (int)std::floor((x - m_gridOrigin.x) / m_cellSize);
+        return std::max(0, std::min(m_cols - 1, c));
+    }
+
+    int EdgeIndex::cellY(float y) const{
+        int c = (int)std::floor((y - m_gridOrigin.y) / m_cellSize);
+        return std::max(0, std::min(m_rows - 1, c));
+    }
+
+    template <typename CellVisitor>
+    void EdgeIndex::forEachCell(const sfu::Line& e, const CellVisitor& f){
+        sf::Vector2f p1 = e.m_origin;
+        sf::Vector2f p2 = e.point(1.f);
+        if(p1.y > p2.y){
+            std::swap(p1, p2);
+        }
+        // Margin to keep the edge in the cells it touches despite rounding
+        float margin = m_cellSize * 0.001f;
+        int r1 = cellY(p1.y - margin);
+        int r2 = cellY(p2.y + margin);
+        float dx = p2.x - p1.x;
+        float dy = p2.y - p1.y;
+        for(int r = r1; r <= r2; r++){
+            // x coordinates of the segment at the limits of the row
+            float x1 = p1.x, x2 = p2.x;
+            if(dy > 0.f){
+                float ya = std::max(p1.y, m_gridOrigin.y + r * m_cellSize);
+                float yb = std::min(p2.y, m_gridOrigin.y + (r + 1) * m_cellSize);
+                x1 = p1.x + dx * (ya - p1.y) / dy;
+                x2 = p1.x + dx * (yb - p1.y) / dy;
+            }
+            int c1 = cellX(std::min(x1, x2) - margin);
+            int c2 = cellX(std::max(x1, x2) + margin);
+            for(int c = c1; c <= c2; c++){
+                f(m_cells[r * m_cols + c]);
+            }
+        }
+    }
+
+    void EdgeIndex::insert(unsigned int id){
+        forEachCell(m_edges[id], [id](std::vector<unsigned int>& cell){
+            cell.push_back(id);
+        });
+    }
+
+    void EdgeIndex::erase(unsigned int id){
+        forEachCell(m_edges[id], [id](std::vector<unsigned int>& cell){
+            auto it = std::find(cell.begin(), cell.end(), id);
+            if(it != cell.end()){
+                cell.erase(it);
+            }
+        });
+    }
+
+    void EdgeIndex::build(const EdgeVector::iterator& begin, const EdgeVector::iterator& end){
+        m_edges.assign(begin, end);
+        m_version = m_baseVersion = newEdgeVersion();
+        m_changes.clear();
+        buildGrid();
+    }
+
+    void EdgeIndex::buildGrid(){
+        m_cells.clear();
+        m_cols = m_rows = 0;
+        if(m_edges.empty()){
+            return;
+        }
+        sf::Vector2f minP = m_edges[0].m_origin;
+        sf::Vector2f maxP = minP;
+        for(auto& e: m_edges){
+            sf::Vector2f p1 = e.m_origin;
+            sf::Vector2f p2 = e.point(1.f);
+            minP.x = std::min(minP.x, std::min(p1.x, p2.x));
+            minP.y = std::min(minP.y, std::min(p1.y, p2.y));
+            maxP.x = std::max(maxP.x, std::max(p1.x, p2.x));
+            maxP.y = std::max(maxP.y, std::max(p1.y, p2.y));
+        }
+        m_gridOrigin = minP;
+        m_cols = 1 + (int)((maxP.x - minP.x) / m_cellSize);
+        m_rows = 1 + (int)((maxP.y - minP.y) / m_cellSize);
+        m_cells.resize(m_cols * m_rows);
+        for(unsigned int id = 0; id < m_edges.size(); id++){
+            insert(id);
+        }
+    }
+
+    void EdgeIndex::update(unsigned int id, const sfu::Line& edge){
+        EdgeChange change{id, m_edges[id], edge, newEdgeVersion()};
+        sf::FloatRect bounds = getBounds();
+        auto inGrid = [&bounds](const sf::Vector2f& p){
+            return p.x >= bounds.left && p.x <= bounds.left + bounds.width
+                && p.y >= bounds.top && p.y <= bounds.top + bounds.height;
+        };
+        // Cells are clamped to the grid, so an edge out of it needs a new one
+        if(!m_cells.empty() && inGrid(edge.m_origin) && inGrid(edge.point(1.f))){
+            erase(id);
+            m_edges[id] = edge;
+            insert(id);
+        }else{
+            m_edges[id] = edge;
+            buildGrid();
+        }
+        m_version = change.version;
+        if(m_changes.size() == MAX_CHANGES){
+            m_baseVersion = m_changes.front().version;
+            m_changes.pop_front();
+        }
+        m_changes.push_back(change);
+        if(m_changeCallback){
+            m_changeCallback(change);
+        }
+    }
+
+    bool EdgeIndex::getChanges(unsigned long version, std::vector<EdgeChange>& changes) const{
+        changes.clear();
+        auto first = m_changes.begin();
+        if(version != m_baseVersion){
+            // The versions of the changes are increasing
+            first = std::lower_bound(m_changes.begin(), m_changes.end(), version,
+                [](const EdgeChange& c, unsigned long v){
+                    return c.version < v;
+                });
+            if(first == m_changes.end() || first->version != version){
+                return false;
+            }
+            first++;
+        }
+        changes.assign(first, m_changes.end());
+        return true;
+    }
+
+    void EdgeIndex::setChangeCallback(const std::function<void(const EdgeChange&)>& callback){
+        m_changeCallback = callback;
+    }
+
+    void EdgeIndex::setCellSize(float cellSize){
+        m_cellSize = cellSize;
+        buildGrid();
+    }
+
+    float EdgeIndex::getCellSize() const{
+        return m_cellSize;
+    }
+
+    unsigned long EdgeIndex::getVersion() const{
+        return m_version;
+    }
+
+    const EdgeVector& EdgeIndex::getEdges() const{
+        return m_edges;
+    }
+
+    sf::FloatRect EdgeIndex::getBounds() const{
+        return sf::FloatRect(m_gridOrigin.x, m_gridOrigin.y, m_cols * m_cellSize, m_rows * m_cellSize);
+    }
+
+    void EdgeIndex::query(const sf::FloatRect& rect, std::vector<unsigned int>& ids) const{
+        ids.clear();
+        if(m_cells.empty() || !getBounds().intersects(rect)){
+            return;
+        }
+        int c1 = cellX(rect.left);
+        int c2 = cellX(rect.left + rect.width);
+        int r1 = cellY(rect.top);
+        int r2 = cellY(rect.top + rect.height);
+        for(int r = r1; r <= r2; r++){
+            for(int c = c1; c <= c2; c++){
+                auto& cell = m_cells[r * m_cols + c];
+                ids.insert(ids.end(), cell.begin(), cell.end());
+            }
+        }
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    }
+
+    bool EdgeIndex::castRay(const sfu::Line& r, float maxRange, float& t) const{
+        if(m_cells.empty()){
+            return false;
+        }
+        sfu::Line ray(r);
+        ray.m_direction = sfu::normalize(ray.m_direction);
+        const sf::Vector2f& o = ray.m_origin;
+        const sf::Vector2f& d = ray.m_direction;
+
+        // Clip the ray to the grid rectangle (slab method)
+        sf::FloatRect bounds = getBounds();
+        float tEnter = 0.f;
+        float tLeave = maxRange;
+        const float lo[2] = {bounds.left, bounds.top};
+        const float hi[2] = {bounds.left + bounds.width, bounds.top + bounds.height};
+        const float po[2] = {o.x, o.y};
+        const float pd[2] = {d.x, d.y};
+        for(int i = 0; i < 2; i++){
+            if(pd[i] == 0.f){
+                if(po[i] < lo[i] || po[i] > hi[i]){
+                    return false;
+                }
+            }else{
+                float t1 = (lo[i] - po[i]) / pd[i];
+                float t2 = (hi[i] - po[i]) / pd[i];
+                tEnter = std::max(tEnter, std::min(t1, t2));
+                tLeave = std::min(tLeave, std::max(t1, t2));
+            }
+        }
+        if(tEnter > tLeave){
+            return false;
+        }
+
+        // Walk the cells crossed by the ray
+        sf::Vector2f start = ray.point(tEnter);
+        int cx = cellX(start.x);
+        int cy = cellY(start.y);
+        int stepX = (d.x > 0.f) - (d.x < 0.f);
+        int stepY = (d.y > 0.f) - (d.y < 0.f);
+        const float inf = std::numeric_limits<float>::infinity();
+        float tNextX = stepX == 0 ? inf : (m_gridOrigin.x + (cx + (stepX > 0)) * m_cellSize - o.x) / d.x;
+        float tNextY = stepY == 0 ? inf : (m_gridOrigin.y + (cy + (stepY > 0)) * m_cellSize - o.y) / d.y;
+        float tDeltaX = stepX == 0 ? inf : m_cellSize / std::abs(d.x);
+        float tDeltaY = stepY == 0 ? inf : m_cellSize / std::abs(d.y);
+
+        float minRange = maxRange;
+        bool hit = false;
+        while(true){
+            CANDLE_PROFILE_COUNT(intersectionTests, m_cells[cy * m_cols + cx].size());
+            for(unsigned int id: m_cells[cy * m_cols + cx]){
+                float t_ray;
+                if(sfu::intersectSegmentRay(m_edges[id], ray, t_ray) && t_ray <= minRange){
+                    minRange = t_ray;
+                    hit = true;
+                }
+            }
+            float tExit = std::min(tNextX, tNextY);
+            // No edge in the following cells can be closer than this hit
+            if((hit && minRange <= tExit) || tExit >= tLeave){
+                break;
+            }
+            if(tNextX < tNextY){
+                cx += stepX;
+                tNextX += tDeltaX;
+                if(cx < 0 || cx >= m_cols) break;
+            }else{
+                cy += stepY;
+                tNextY += tDeltaY;
+                if(cy < 0 || cy >= m_rows) break;
+            }
+        }
+        t = minRange;
+        return hit;
+    }
+
+    sf::Vector2f EdgeIndex::castRay(const sfu::Line& ray, float maxRange) const{
+        float t;
+        if(!castRay(ray, maxRange, t)){
+            t = maxRange;
+        }
+        return ray.m_origin + t * sfu::normalize(ray.m_direction);
+    }
+}
@@ -0,0 +1,138 @@
+#include "Candle/EdgeMesh.hpp"
+
+#include <cmath>
+#include <cstring>
+
+#include "Candle/geometry/Vector2.hpp"
+
+namespace candle{
+    EdgeMesh::EdgeMesh(float tolerance)
+        : m_tolerance(tolerance)
+        , m_version(newEdgeVersion())
+        {}
+
+    EdgeMesh::EdgeMesh(const EdgeVector::iterator& begin, const EdgeVector::iterator& end, float tolerance)
+        : m_tolerance(tolerance)
+        , m_version(newEdgeVersion())
+        {
+        addEdges(begin, end);
+    }
+
+    std::uint64_t EdgeMesh::cellKey(const sf::Vector2f& point, int dx, int dy) const{
+        std::uint32_t x, y;
+        if(m_tolerance > 0.f){
+            // Cells as big as the tolerance
+            x = (std::int32_t)std::floor(point.x / m_tolerance) + dx;
+            y = (std::int32_t)std::floor(point.y / m_tolerance) + dy;
+        }else{
+            // One cell for each point, with -0 and 0 in the same one
+            float px = point.x + 0.f, py = point.y + 0.f;
+            std::memcpy(&x, &px, sizeof(x));
+            std::memcpy(&y, &py, sizeof(y));
+        }
+        return (std::uint64_t)x << 32 | y;
+    }
+
+    void EdgeMesh::clear(){
+        m_vertices.clear();
+        m_segments.clear();
+        m_edges.clear();
+        m_vertexSegments.clear();
+        m_cells.clear();
+        m_version = newEdgeVersion();
+    }
+
+    unsigned int EdgeMesh::addVertex(const sf::Vector2f& point){
+        // The point may be welded to a vertex of a neighbouring cell
+        int reach = m_tolerance > 0.f ? 1 : 0;
+        for(int dy = -reach; dy <= reach; dy++){
+            for(int dx = -reach; dx <= reach; dx++){
+                auto it = m_cells.find(cellKey(point, dx, dy));
+                if(it == m_cells.end()){
+                    continue;
+                }
+                for(unsigned int v: it->second){
+                    sf::Vector2f d = m_vertices[v] - point;
+                    if(sfu::dot(d, d) <= m_tolerance * m_tolerance){
+                        return v;
+                    }
+                }
+            }
+        }
+        unsigned int v = m_vertices.size();
+        m_vertices.push_back(point);
+        m_vertexSegments.emplace_back();
+        m_cells[cellKey(point, 0, 0)].push_back(v);
+        return v;
+    }
+
+    void EdgeMesh::addSegment(unsigned int a, unsigned int b, int solidSide){
+        if(a == b){
+            return;
+        }
+        unsigned int s = m_segments.size();
+        m_segments.push_back(Segment{a, b, solidSide});
+        m_edges.emplace_back(m_vertices[a], m_vertices[b]);
+        m_vertexSegments[a].push_back(s);
+        m_vertexSegments[b].push_back(s);
+        m_version = newEdgeVersion();
+    }
+
+    void EdgeMesh::addEdge(const Edge& edge){
+        unsigned int a = addVertex(edge.m_origin);
+        addSegment(a, addVertex(edge.point(1.f)));
+    }
+
+    void EdgeMesh::addEdges(const EdgeVector::iterator& begin, const EdgeVector::iterator& end){
+        for(auto it = begin; it != end; it++){
+            addEdge(*it);
+        }
+    }
+
+    void EdgeMesh::addPolygon(const sfu::Polygon& polygon, bool solid){
+        const std::vector<sfu::Line>& lines = polygon.lines;
+        unsigned int n = lines.size();
+        if(n == 0){
+            return;
+        }
+        // The inside is on the positive side of every segment if the
+        // polygon has a positive area
+        float area = 0.f;
+        for(unsigned int i = 0; i < n; i++){
+            const sf::Vector2f& p = lines[i].m_origin;
+            const sf::Vector2f& q = lines[(i+1) % n].m_origin;
+            area += p.x * q.y - p.y * q.x;
+        }
+        int solidSide = 0;
+        if(solid && area != 0.f){
+            solidSide = area > 0.f ? 1 : -1;
+        }
+        unsigned int first = addVertex(lines[0].m_origin);
+        unsigned int a = first;
+        for(unsigned int i = 1; i <= n; i++){
+            unsigned int b = i < n ? addVertex(lines[i].m_origin) : first;
+            addSegment(a, b, solidSide);
+            a = b;
+        }
+    }
+
+    const std::vector<sf::Vector2f>& EdgeMesh::getVertices() const{
+        return m_vertices;
+    }
+
+    const std::vector<EdgeMesh::Segment>& EdgeMesh::getSegments() const{
+        return m_segments;
+    }
+
+    const EdgeVector& EdgeMesh::getEdges() const{
+        return m_edges;
+    }
+
+    const std::vector<unsigned int>& EdgeMesh::getVertexSegments(unsigned int vertex) const{
+        return m_vertexSegments[vertex];
+    }
+
+    unsigned long EdgeMesh::getVersion() const{
+        return m_version;
+    }
+}
@@ -0,0 +1,137 @@
+#include "Candle/EdgeOptimization.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "Candle/EdgeMesh.hpp"
+#include "Candle/geometry/Vector2.hpp"
+
+namespace candle{
+    namespace{
+        // Maximum difference, in radians, between the directions of two
+        // edges on the same line
+        const float ANGLE_TOLERANCE = 1e-4f;
+
+        // Edge with its ends in increasing x (or y, if vertical), and the
+        // direction in which it was given
+        struct LineItem{
+            sf::Vector2f a, b;
+            float angle;
+            float offset;
+            int sign;
+        };
+
+        // End of an edge along its line
+        struct LineEvent{
+            float s;
+            int delta;
+            sf::Vector2f point;
+        };
+
+        // Adds the pieces of a group of edges on the same line to the output
+        void mergeLine(std::vector<LineItem>::iterator begin, std::vector<LineItem>::iterator end, float tolerance, bool removeInterior, std::vector<LineEvent>& events, EdgeVector& out){
+            sf::Vector2f u = sfu::normalize(begin->b - begin->a);
+            events.clear();
+            for(auto it = begin; it != end; ++it){
+                int weight = removeInterior ? it->sign : 1;
+                events.push_back(LineEvent{sfu::dot(u, it->a), weight, it->a});
+                events.push_back(LineEvent{sfu::dot(u, it->b), -weight, it->b});
+            }
+            std::sort(events.begin(), events.end(), [](const LineEvent& e1, const LineEvent& e2){
+                return e1.s < e2.s;
+            });
+            // The sign of the number of edges covering each piece, counted
+            // in their direction, tells if it is kept and in which direction
+            int value = 0;
+            sf::Vector2f runStart;
+            for(std::size_t i = 0; i < events.size();){
+                const LineEvent& first = events[i];
+                int next = value;
+                for(; i < events.size() && events[i].s - first.s <= tolerance; i++){
+                    next += events[i].delta;
+                }
+                int before = (value > 0) - (value < 0);
+                int after = (next > 0) - (next < 0);
+                if(before != after){
+                    if(before > 0){
+                        out.emplace_back(runStart, first.point);
+                    }else if(before < 0){
+                        out.emplace_back(first.point, runStart);
+                    }
+                    runStart = first.point;
+                }
+                value = next;
+            }
+        }
+    }
+
+    EdgeOptimizationReport optimizeEdges(EdgeVector& edges, float tolerance, bool removeInterior){
+        EdgeOptimizationReport report;
+        report.inputEdges = edges.size();
+        report.weldedVertices = 0;
+
+        // Weld the ends and drop the edges without length
+        EdgeMesh mesh(tolerance);
+        for(const Edge& edge: edges){
+            sf::Vector2f a = edge.m_origin;
+            sf::Vector2f b = edge.point(1.f);
+            unsigned int ia = mesh.addVertex(a);
+            unsigned int ib = mesh.addVertex(b);
+            report.weldedVertices += (mesh.getVertices()[ia] != a) + (mesh.getVertices()[ib] != b);
+            mesh.addSegment(ia, ib);
+        }
+        report.degenerateEdges = edges.size() - mesh.getSegments().size();
+        std::vector<LineItem> items;
+        items.reserve(mesh.getSegments().size());
+        for(const EdgeMesh::Segment& segment: mesh.getSegments()){
+            LineItem item;
+            item.a = mesh.getVertices()[segment.a];
+            item.b = mesh.getVertices()[segment.b];
+            sf::Vector2f d = item.b - item.a;
+            item.sign = 1;
+            if(d.x < 0.f || (d.x == 0.f && d.y < 0.f)){
+                std::swap(item.a, item.b);
+                item.sign = -1;
+                d = -d;
+            }
+            item.angle = std::atan2(d.y, d.x);
+            items.push_back(item);
+        }
+
+        // Group the edges with the same direction, then the ones on the same
+        // line among them
+        std::sort(items.begin(), items.end(), [](const LineItem& i1, const LineItem& i2){
+            return i1.angle < i2.angle;
+        });
+        EdgeVector out;
+        std::vector<LineEvent> events;
+        for(auto group = items.begin(); group != items.end();){
+            auto groupEnd = group;
+            while(groupEnd != items.end() && groupEnd->angle - group->angle <= ANGLE_TOLERANCE){
+                ++groupEnd;
+            }
+            sf::Vector2f u = sfu::normalize(group->b - group->a);
+            sf::Vector2f n(-u.y, u.x);
+            for(auto it = group; it != groupEnd; ++it){
+                it->offset = sfu::dot(n, it->a);
+            }
+            std::sort(group, groupEnd, [](const LineItem& i1, const LineItem& i2){
+                return i1.offset < i2.offset;
+            });
+            for(auto line = group; line != groupEnd;){
+                auto lineEnd = line;
+                while(lineEnd != groupEnd && lineEnd->offset - line->offset <= tolerance){
+                    ++lineEnd;
+                }
+                mergeLine(line, lineEnd, tolerance, removeInterior, events, out);
+                line = lineEnd;
+            }
+            group = groupEnd;
+        }
+
+        edges.swap(out);
+        report.outputEdges = edges.size();
+        return report;
+    }
+}
@@ -0,0 +1,42 @@
+#include "Candle/LightBatch.hpp"
+
+namespace candle{
+    LightBatch::LightBatch()
+        : m_fadeTriangles(sf::Triangles)
+        , m_plainTriangles(sf::Triangles)
+        , m_lightCount(0)
+        {}
+
+    void LightBatch::clear(){
+        m_fadeTriangles.clear();
+        m_plainTriangles.clear();
+        m_lightCount = 0;
+    }
+
+    void LightBatch::add(const RadialLight& light){
+        light.appendTriangles(light.getFade() ? m_fadeTriangles : m_plainTriangles);
+        m_lightCount++;
+    }
+
+    unsigned int LightBatch::getLightCount() const{
+        return m_lightCount;
+    }
+
+    unsigned int LightBatch::getVertexCount() const{
+        return m_fadeTriangles.getVertexCount() + m_plainTriangles.getVertexCount();
+    }
+
+    void LightBatch::draw(sf::RenderTarget& t, sf::RenderStates s) const{
+        if(s.blendMode == sf::BlendAlpha){ // the default
+            s.blendMode = sf::BlendAdd;
+        }
+        if(m_fadeTriangles.getVertexCount() > 0){
+            RadialLight::setLightStates(s, true);
+            t.draw(m_fadeTriangles, s);
+        }
+        if(m_plainTriangles.getVertexCount() > 0){
+            RadialLight::setLightStates(s, false);
+            t.draw(m_plainTriangles, s);
+        }
+    }
+}
@@ -1,21 +1,114 @@
 #include "Candle/LightSource.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <utility>
 
 #include "Candle/Constants.hpp"
+#include "Candle/CastScratch.hpp"
+#include "Candle/EdgeIndex.hpp"
+#include "Candle/EdgeBuffer.hpp"
+#include "Candle/EdgeMesh.hpp"
+#include "Candle/Occluder.hpp"
+#include "Candle/VertexSink.hpp"
 #include "Candle/geometry/Line.hpp"
 #include "Candle/geometry/Vector2.hpp"
 #include "Candle/graphics/VertexArray.hpp"
 
 namespace candle{
+    namespace{
+        // Size of the lights, in units of their tolerance, below which the
+        // level of detail merges rays and drops the extra ones
+        const float LOD_COARSE_SIZE = 32.f;
+        // Size of the lights, in pixels, above which setLodFromView keeps
+        // all the details
+        const float LOD_FULL_PIXELS = 128.f;
+    }
+
+    unsigned long newEdgeVersion(){
+        static std::atomic<unsigned long> s_lastVersion(0);
+        return ++s_lastVersion;
+    }
+    
     LightSource::LightSource()
         : m_color(sf::Color::White)
         , m_fade(true)
+        , m_castDirty(true)
+        , m_bufferDirty(true)
+        , m_lodTolerance(0.f)
+        , m_occluders(nullptr)
 #ifdef CANDLE_DEBUG
         , m_debug(sf::Lines, 0)
 #endif
+        , m_castEdgeVersion(0)
+        , m_castOccluderVersion(0)
+        , m_scratch(nullptr)
+        , m_storage(VERTEX_ARRAY)
+        , m_doubleBuffered(false)
+        , m_frontDirty(false)
         {}
     
+    LightSource::LightSource(const LightSource& other)
+        : sf::Transformable(other)
+        , sf::Drawable(other)
+        , m_color(other.m_color)
+        , m_polygon(other.m_polygon)
+        , m_range(other.m_range)
+        , m_intensity(other.m_intensity)
+        , m_fade(other.m_fade)
+        , m_castDirty(other.m_castDirty)
+        , m_bufferDirty(true)
+        , m_lodTolerance(other.m_lodTolerance)
+        , m_occluders(other.m_occluders)
+#ifdef CANDLE_DEBUG
+        , m_debug(other.m_debug)
+#endif
+        , m_castTransform(other.m_castTransform)
+        , m_castEdgeVersion(other.m_castEdgeVersion)
+        , m_castOccluderVersion(other.m_castOccluderVersion)
+        , m_scratch(other.m_scratch)
+        , m_storage(other.m_storage)
+        , m_doubleBuffered(other.m_doubleBuffered)
+        , m_front(other.m_front)
+        , m_frontTransform(other.m_frontTransform)
+        , m_frontDirty(true)
+        {
+        // The back polygon may still be newer than the front one
+        m_bufferDirty = m_doubleBuffered ? other.m_bufferDirty : true;
+    }
+    
+    LightSource& LightSource::operator=(const LightSource& other){
+        sf::Transformable::operator=(other);
+        m_color = other.m_color;
+        m_polygon = other.m_polygon;
+        m_range = other.m_range;
+        m_intensity = other.m_intensity;
+        m_fade = other.m_fade;
+        m_castDirty = other.m_castDirty;
+        m_lodTolerance = other.m_lodTolerance;
+        m_occluders = other.m_occluders;
+#ifdef CANDLE_DEBUG
+        m_debug = other.m_debug;
+#endif
+        m_castTransform = other.m_castTransform;
+        m_castEdgeVersion = other.m_castEdgeVersion;
+        m_castOccluderVersion = other.m_castOccluderVersion;
+        m_scratch = other.m_scratch;
+        m_storage = other.m_storage;
+        if(m_storage == VERTEX_ARRAY){
+            m_buffer.reset();
+        }
+        m_doubleBuffered = other.m_doubleBuffered;
+        m_front = other.m_front;
+        m_frontTransform = other.m_frontTransform;
+        // The polygon to draw has to be uploaded again, and the back one
+        // may still be newer than the front one
+        m_bufferDirty = m_doubleBuffered ? other.m_bufferDirty : true;
+        m_frontDirty = true;
+        return *this;
+    }
+    
     void LightSource::setIntensity(float intensity){
         m_color.a = 255 * intensity;
         resetColor();
@@ -46,10 +139,317 @@ namespace candle{
     
     void LightSource::setRange(float r){
         m_range = r;
+        m_castDirty = true;
     }
     
     float LightSource::getRange() const{
         return m_range;
     }
     
+    sf::FloatRect LightSource::getGlobalBounds() const{
+        return getFrontTransform().transformRect(getFrontPolygon().getBounds());
+    }
+    
+    float LightSource::getIntensityAt(const sf::Vector2f&, sf::Vector2f& source) const{
+        source = Transformable::getPosition();
+        return 0.f;
+    }
+    
+    void LightSource::castLight(const EdgeIndex& index){
+        // The iterators of the version of the subclass are not const
+        EdgeVector edges(index.getEdges());
+        castLight(edges.begin(), edges.end());
+    }
+    
+    void LightSource::castLight(const EdgeBuffer& buffer){
+        EdgeVector edges;
+        edges.reserve(buffer.size());
+        for(unsigned int i = 0; i < buffer.size(); i++){
+            edges.push_back(buffer.getEdge(i));
+        }
+        castLight(edges.begin(), edges.end());
+    }
+    
+    void LightSource::castLight(const EdgeMesh& mesh){
+        EdgeVector edges(mesh.getEdges());
+        castLight(edges.begin(), edges.end());
+    }
+    
+    bool LightSource::castLightChanges(const EdgeIndex& index, const std::vector<EdgeChange>&){
+        castLight(index);
+        return true;
+    }
+    
+    bool LightSource::transformChanged() const{
+        const sf::Transform& transform = getTransform();
+        const float* a = transform.getMatrix();
+        const float* b = m_castTransform.getMatrix();
+        return !std::equal(a, a + 16, b);
+    }
+    
+    unsigned long LightSource::occluderVersion() const{
+        return m_occluders ? m_occluders->getVersion() : 0;
+    }
+    
+    bool LightSource::needsCast(unsigned long edgeVersion) const{
+        return m_castDirty || edgeVersion != m_castEdgeVersion || transformChanged()
+            || occluderVersion() != m_castOccluderVersion;
+    }
+    
+    void LightSource::castDone(unsigned long edgeVersion){
+        m_castTransform = getTransform();
+        m_castEdgeVersion = edgeVersion;
+        m_castOccluderVersion = occluderVersion();
+        m_castDirty = false;
+    }
+    
+    bool LightSource::castLightIfNeeded(const EdgeVector::iterator& begin, const EdgeVector::iterator& end, unsigned long edgeVersion){
+        if(!needsCast(edgeVersion)){
+            return false;
+        }
+        castLight(begin, end);
+        castDone(edgeVersion);
+        return true;
+    }
+    
+    bool LightSource::castLightIfNeeded(const EdgeIndex& index){
+        if(!needsCast(index.getVersion())){
+            return false;
+        }
+        bool casted = true;
+        CastScratch& scratch = castScratch();
+        std::vector<EdgeChange>& changes = scratch.m_changes;
+        scratch.beginCast();
+        // Moved occluders may be anywhere, so only the changes of the index
+        // alone are casted in part
+        bool changed = !m_castDirty && !transformChanged() && occluderVersion() == m_castOccluderVersion
+            && index.getChanges(m_castEdgeVersion, changes);
+        scratch.endCast();
+        if(changed){
+            casted = castLightChanges(index, changes);
+        }else{
+            castLight(index);
+        }
+        castDone(index.getVersion());
+        return casted;
+    }
+    
+    void LightSource::setCastScratch(CastScratch* scratch){
+        m_scratch = scratch;
+    }
+    
+    CastScratch* LightSource::getCastScratch() const{
+        return m_scratch;
+    }
+    
+    void LightSource::setOccluders(const OccluderList* occluders){
+        m_occluders = occluders;
+        m_castDirty = true;
+    }
+    
+    const OccluderList* LightSource::getOccluders() const{
+        return m_occluders;
+    }
+    
+    CastScratch& LightSource::castScratch(){
+        return m_scratch ? *m_scratch : CastScratch::getThreadScratch();
+    }
+    
+    bool LightSource::castLightIfNeeded(const EdgeBuffer& edges){
+        if(!needsCast(edges.getVersion())){
+            return false;
+        }
+        castLight(edges);
+        castDone(edges.getVersion());
+        return true;
+    }
+    
+    bool LightSource::castLightIfNeeded(const EdgeMesh& mesh){
+        if(!needsCast(mesh.getVersion())){
+            return false;
+        }
+        castLight(mesh);
+        castDone(mesh.getVersion());
+        return true;
+    }
+    
+    void LightSource::setVertexStorage(VertexStorage storage){
+        m_storage = storage;
+        m_bufferDirty = true;
+        if(storage == VERTEX_ARRAY){
+            m_buffer.reset();
+        }
+    }
+    
+    LightSource::VertexStorage LightSource::getVertexStorage() const{
+        return m_storage;
+    }
+    
+    void LightSource::setLodTolerance(float tolerance){
+        m_lodTolerance = std::max(0.f, tolerance);
+        m_castDirty = true;
+    }
+    
+    float LightSource::getLodTolerance() const{
+        return m_lodTolerance;
+    }
+    
+    bool LightSource::isCoarseLod(float size) const{
+        return m_lodTolerance > 0.f && size < LOD_COARSE_SIZE * m_lodTolerance;
+    }
+    
+    void LightSource::setLodFromView(const sf::View& view, float pixels){
+        sf::FloatRect viewRect = view.getInverseTransform().transformRect(sf::FloatRect(-1.f, -1.f, 2.f, 2.f));
+        float tolerance = m_range;
+        sf::FloatRect bounds = getGlobalBounds();
+        if(bounds.intersects(viewRect)){
+            float pixel = std::max(viewRect.width, viewRect.height) / pixels;
+            if(std::max(bounds.width, bounds.height) > LOD_FULL_PIXELS * pixel){
+                tolerance = 0.f;
+            }else{
+                tolerance = std::pow(2.f, std::ceil(std::log2(pixel)));
+            }
+        }
+        if(tolerance != m_lodTolerance){
+            setLodTolerance(tolerance);
+        }
+    }
+    
+    void LightSource::drawPolygon(sf::RenderTarget& t, const sf::RenderStates& s) const{
+        const sf::VertexArray& polygon = getFrontPolygon();
+        std::size_t n = polygon.getVertexCount();
+        if(m_storage == VERTEX_ARRAY || n == 0 || !sf::VertexBuffer::isAvailable()){
+            t.draw(polygon, s);
+            return;
+        }
+        // The flag of the back polygon is not touched while it is casted
+        bool& dirty = m_doubleBuffered ? m_frontDirty : m_bufferDirty;
+        if(!m_buffer){
+            // Dynamic usage: the buffer is rewritten after each cast, but
+            // drawn many times in between
+            m_buffer.reset(new sf::VertexBuffer(sf::Points, sf::VertexBuffer::Dynamic));
+            dirty = true;
+        }
+        if(dirty){
+            m_buffer->setPrimitiveType(polygon.getPrimitiveType());
+            if(m_buffer->getVertexCount() < n && !m_buffer->create(n)){
+                t.draw(polygon, s);
+                return;
+            }
+            m_buffer->update(&polygon[0], n, 0);
+            dirty = false;
+        }
+        t.draw(*m_buffer, 0, n, s);
+    }
+    
+    sf::Transform LightSource::getPolygonTransform() const{
+        return getTransform();
+    }
+    
+    const sf::VertexArray& LightSource::getFrontPolygon() const{
+        return m_doubleBuffered ? m_front : m_polygon;
+    }
+    
+    sf::Transform LightSource::getFrontTransform() const{
+        return m_doubleBuffered ? m_frontTransform : getPolygonTransform();
+    }
+    
+    sf::VertexArray& LightSource::getLatestPolygon(){
+        return !m_doubleBuffered || m_bufferDirty ? m_polygon : m_front;
+    }
+    
+    void LightSource::latestPolygonChanged(){
+        if(!m_doubleBuffered || m_bufferDirty){
+            m_bufferDirty = true;
+        }else{
+            m_frontDirty = true;
+        }
+    }
+    
+    void LightSource::setDoubleBuffered(bool doubleBuffered){
+        if(doubleBuffered == m_doubleBuffered){
+            return;
+        }
+        if(doubleBuffered){
+            m_front = m_polygon;
+            m_frontTransform = getPolygonTransform();
+            m_frontDirty = true;
+            m_bufferDirty = false;
+        }else{
+            // Keep the newest polygon
+            if(!m_bufferDirty){
+                std::swap(m_polygon, m_front);
+            }
+            m_front.clear();
+            m_bufferDirty = true;
+        }
+        m_doubleBuffered = doubleBuffered;
+    }
+    
+    bool LightSource::isDoubleBuffered() const{
+        return m_doubleBuffered;
+    }
+    
+    std::size_t LightSource::castLightInto(const EdgeVector::iterator& begin, const EdgeVector::iterator& end, VertexSink& sink){
+        castLight(begin, end);
+        return appendCastTriangles(sink);
+    }
+    
+    std::size_t LightSource::appendCastTriangles(VertexSink& sink) const{
+        std::size_t n = countTriangleVertices(m_polygon);
+        std::size_t offset = sink.allocate(n);
+        if(offset != VertexSink::FULL && n > 0){
+            writeTriangles(m_polygon, getPolygonTransform(), sink.getVertices() + offset);
+        }
+        return offset;
+    }
+    
+    std::size_t LightSource::getTriangleVertexCount() const{
+        return countTriangleVertices(getFrontPolygon());
+    }
+    
+    void LightSource::appendTriangles(sf::VertexArray& triangles) const{
+        std::size_t n = getTriangleVertexCount();
+        std::size_t k = triangles.getVertexCount();
+        if(n > 0){
+            triangles.resize(k + n);
+            writeTriangles(getFrontPolygon(), getFrontTransform(), &triangles[k]);
+        }
+    }
+    
+    std::size_t LightSource::appendTriangles(VertexSink& sink) const{
+        std::size_t n = getTriangleVertexCount();
+        std::size_t offset = sink.allocate(n);
+        if(offset != VertexSink::FULL && n > 0){
+            writeTriangles(getFrontPolygon(), getFrontTransform(), sink.getVertices() + offset);
+        }
+        return offset;
+    }
+    
+    bool LightSource::swapBuffers(){
+        if(!m_doubleBuffered || !m_bufferDirty){
+            return false;
+        }
+        std::swap(m_polygon, m_front);
+        m_frontTransform = getPolygonTransform();
+        m_bufferDirty = false;
+        m_frontDirty = true;
+        return true;
+    }
+    
+    std::size_t LightSource::countTriangleVertices(const sf::VertexArray&) const{
+        return 0;
+    }
+    
+    void LightSource::writeTriangles(const sf::VertexArray&, const sf::Transform&, sf::Vertex*) const{
+    }
+    
+    float LightSource::getFalloffAt(const sf::Vector2f&) const{
+        return 1.f;
+    }
+    
+    bool LightSource::getFalloffCircle(sf::Vector2f&, float&) const{
+        return false;
+    }
+    
 }
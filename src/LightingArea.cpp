@@ -1,4 +1,9 @@
 #include "Candle/LightingArea.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Candle/Stats.hpp"
 #include "Candle/graphics/VertexArray.hpp"
 
 
@@ -12,27 +17,63 @@ namespace candle{
         sf::BlendMode::Factor::OneMinusSrcAlpha,  // alpha dst
         sf::BlendMode::Equation::Add    );            // alpha eq
     
+    namespace{
+#ifdef CANDLE_PROFILE
+        // Pixels of a texture of the given size covered by a rectangle
+        unsigned long pixelCount(const sf::FloatRect& rect, const sf::Vector2u& size){
+            sf::FloatRect r;
+            if(!rect.intersects(sf::FloatRect(0.f, 0.f, size.x, size.y), r)){
+                return 0;
+            }
+            return r.width * r.height;
+        }
+#endif
+        
+        sf::IntRect unite(const sf::IntRect& a, const sf::IntRect& b){
+            int left = std::min(a.left, b.left);
+            int top = std::min(a.top, b.top);
+            int right = std::max(a.left + a.width, b.left + b.width);
+            int bottom = std::max(a.top + a.height, b.top + b.height);
+            return sf::IntRect(left, top, right - left, bottom - top);
+        }
+    }
+    
     void LightingArea::initializeRenderTexture(const sf::Vector2f& size){
-        m_renderTexture.create(size.x, size.y);
+        m_size = size;
+        // The texture may be smaller than the area, and is stretched to it
+        sf::Vector2f scaled = size * m_resolutionScale;
+        m_renderTexture.create(std::max(1.f, std::ceil(scaled.x)), std::max(1.f, std::ceil(scaled.y)));
         m_renderTexture.setSmooth(true);
+        m_areaQuad[0].position = {0, 0};
+        m_areaQuad[1].position = {size.x, 0};
+        m_areaQuad[2].position = {size.x, size.y};
+        m_areaQuad[3].position = {0, size.y};
         m_baseTextureQuad[0].position =
-        m_areaQuad[0].position =
         m_areaQuad[0].texCoords = {0, 0};
         m_baseTextureQuad[1].position =
-        m_areaQuad[1].position =
-        m_areaQuad[1].texCoords = {size.x, 0};
+        m_areaQuad[1].texCoords = {scaled.x, 0};
         m_baseTextureQuad[2].position =
-        m_areaQuad[2].position =
-        m_areaQuad[2].texCoords = {size.x, size.y};
+        m_areaQuad[2].texCoords = {scaled.x, scaled.y};
         m_baseTextureQuad[3].position =
-        m_areaQuad[3].position =
-        m_areaQuad[3].texCoords = {0, size.y};
+        m_areaQuad[3].texCoords = {0, scaled.y};
+        m_fullyDirty = true;
+    }
+    
+    sf::Transform LightingArea::getFogTransform() const{
+        // From global coordinates to the pixels of the texture
+        sf::Transform transform;
+        transform.scale(m_resolutionScale, m_resolutionScale);
+        return transform * Transformable::getInverseTransform();
     }
     
     LightingArea::LightingArea(Mode mode, const sf::Vector2f& position, const sf::Vector2f& size)
     : m_baseTextureQuad(sf::Quads, 4)
     , m_areaQuad(sf::Quads, 4)
     , m_color(sf::Color::White)
+    , m_resolutionScale(1.f)
+    , m_fullyDirty(true)
+    , m_clipping(false)
+    , m_staticDirty(true)
     {
         m_opacity = 1.f;
         m_mode = mode;
@@ -45,6 +86,10 @@ namespace candle{
     : m_baseTextureQuad(sf::Quads, 4)
     , m_areaQuad(sf::Quads, 4)
     , m_color(sf::Color::White)
+    , m_resolutionScale(1.f)
+    , m_fullyDirty(true)
+    , m_clipping(false)
+    , m_staticDirty(true)
     {
         m_opacity = 1.f;
         m_mode = mode;
@@ -70,18 +115,224 @@ namespace candle{
         }
     }
     
-    void LightingArea::clear(){
+    bool LightingArea::transformChanged() const{
+        const float* a = Transformable::getTransform().getMatrix();
+        const float* b = m_clearTransform.getMatrix();
+        return !std::equal(a, a + 16, b);
+    }
+    
+    void LightingArea::clearBase(sf::RenderTexture& target){
+        CANDLE_PROFILE_COUNT(pixels, target.getSize().x * target.getSize().y);
         if(m_baseTexture != nullptr){
-            m_renderTexture.clear(sf::Color::Transparent);
-            m_renderTexture.draw(m_baseTextureQuad, m_baseTexture);
+            target.clear(sf::Color::Transparent);
+            target.draw(m_baseTextureQuad, m_baseTexture);
+            CANDLE_PROFILE_COUNT(drawCalls, 1);
+            CANDLE_PROFILE_COUNT(pixels, target.getSize().x * target.getSize().y);
+        }else{
+            target.clear(getActualColor());
+        }
+    }
+    
+    void LightingArea::updateStaticCache(){
+        sf::Vector2u size = m_renderTexture.getSize();
+        if(!m_staticTexture){
+            m_staticTexture.reset(new sf::RenderTexture);
+        }
+        if(m_staticTexture->getSize() != size){
+            m_staticTexture->create(size.x, size.y);
+        }
+        clearBase(*m_staticTexture);
+        if(m_opacity > 0.f && m_mode == FOG){
+            sf::RenderStates fogrs;
+            fogrs.blendMode = l_substractAlpha;
+            fogrs.transform = getFogTransform();
+            for(auto light: m_staticLights){
+                m_staticTexture->draw(*light, fogrs);
+                CANDLE_PROFILE_COUNT(drawCalls, 1);
+                CANDLE_PROFILE_COUNT(pixels, pixelCount(fogrs.transform.transformRect(light->getGlobalBounds()), size));
+            }
+        }
+        m_staticTexture->display();
+        m_staticDirty = false;
+    }
+    
+    void LightingArea::drawStaticCache(){
+        // BlendNone copies the cache as it is, alpha included
+        sf::Vertex quad[4];
+        for(int i = 0; i < 4; i++){
+            quad[i].position = quad[i].texCoords = m_baseTextureQuad[i].position;
+        }
+        sf::RenderStates s(sf::BlendNone);
+        s.texture = &m_staticTexture->getTexture();
+        m_renderTexture.draw(quad, 4, sf::Quads, s);
+    }
+    
+    void LightingArea::clear(){
+        CANDLE_PROFILE_SCOPE(AREA_CLEAR, this);
+        if(m_staticLights.empty()){
+            clearBase(m_renderTexture);
         }else{
-            m_renderTexture.clear(getActualColor());
+            if(m_staticDirty || m_fullyDirty || transformChanged()){
+                updateStaticCache();
+            }
+            drawStaticCache();
+            CANDLE_PROFILE_COUNT(drawCalls, 1);
+            CANDLE_PROFILE_COUNT(pixels, m_renderTexture.getSize().x * m_renderTexture.getSize().y);
         }
+        m_dirtyRects.clear();
+        m_fullyDirty = false;
+        m_clipping = false;
+        m_clearTransform = Transformable::getTransform();
+    }
+    
+    void LightingArea::invalidate(const sf::FloatRect& rect){
+        if(m_fullyDirty){
+            return;
+        }
+        sf::FloatRect local = getFogTransform().transformRect(rect);
+        int left = std::floor(local.left);
+        int top = std::floor(local.top);
+        sf::IntRect r(left, top,
+            (int)std::ceil(local.left + local.width) - left,
+            (int)std::ceil(local.top + local.height) - top);
+        sf::Vector2u size = m_renderTexture.getSize();
+        if(!r.intersects(sf::IntRect(0, 0, size.x, size.y), r)){
+            return;
+        }
+        // Merge with the overlapping rects, until none overlaps
+        for(unsigned int i = 0; i < m_dirtyRects.size(); ){
+            if(m_dirtyRects[i].intersects(r)){
+                r = unite(r, m_dirtyRects[i]);
+                m_dirtyRects[i] = m_dirtyRects.back();
+                m_dirtyRects.pop_back();
+                i = 0;
+            }else{
+                i++;
+            }
+        }
+        if(m_dirtyRects.size() == MAX_DIRTY_RECTS){
+            for(auto& d: m_dirtyRects){
+                r = unite(r, d);
+            }
+            m_dirtyRects.clear();
+        }
+        m_dirtyRects.push_back(r);
+    }
+    
+    void LightingArea::invalidate(const LightSource& light){
+        invalidate(light.getGlobalBounds());
+    }
+    
+    sf::View LightingArea::getClipView(const sf::IntRect& rect) const{
+        sf::Vector2f size(m_renderTexture.getSize());
+        sf::FloatRect area(rect);
+        sf::View view(area);
+        view.setViewport(sf::FloatRect(
+            rect.left / size.x, rect.top / size.y,
+            rect.width / size.x, rect.height / size.y));
+        return view;
+    }
+    
+    void LightingArea::clearDirty(){
+        CANDLE_PROFILE_SCOPE(AREA_CLEAR, this);
+        bool staticDirty = !m_staticLights.empty() && m_staticDirty;
+        if(m_fullyDirty || staticDirty || transformChanged()){
+            clear();
+            return;
+        }
+        sf::Vertex quad[4];
+        for(int i = 0; i < 4; i++){
+            quad[i] = m_baseTextureQuad[i];
+        }
+        for(auto& rect: m_dirtyRects){
+            // The viewport clips the quads to the rect
+            m_renderTexture.setView(getClipView(rect));
+            CANDLE_PROFILE_COUNT(drawCalls, 1);
+            CANDLE_PROFILE_COUNT(pixels, rect.width * rect.height);
+            if(!m_staticLights.empty()){
+                drawStaticCache();
+            }else if(m_baseTexture != nullptr){
+                for(int i = 0; i < 4; i++){
+                    quad[i].color = sf::Color::Transparent;
+                }
+                m_renderTexture.draw(quad, 4, sf::Quads, sf::BlendNone);
+                m_renderTexture.draw(m_baseTextureQuad, m_baseTexture);
+                CANDLE_PROFILE_COUNT(drawCalls, 1);
+                CANDLE_PROFILE_COUNT(pixels, rect.width * rect.height);
+            }else{
+                m_renderTexture.draw(quad, 4, sf::Quads, sf::BlendNone);
+            }
+        }
+        m_renderTexture.setView(m_renderTexture.getDefaultView());
+        m_clipping = true;
+    }
+    
+    void LightingArea::addStatic(const LightSource& light){
+        m_staticLights.push_back(&light);
+        m_staticDirty = true;
+    }
+    
+    void LightingArea::removeStatic(const LightSource& light){
+        auto it = std::find(m_staticLights.begin(), m_staticLights.end(), &light);
+        if(it != m_staticLights.end()){
+            m_staticLights.erase(it);
+            m_staticDirty = true;
+        }
+        if(m_staticLights.empty()){
+            m_staticTexture.reset(nullptr);
+        }
+    }
+    
+    void LightingArea::clearStatic(){
+        m_staticLights.clear();
+        m_staticTexture.reset(nullptr);
+        m_staticDirty = true;
+    }
+    
+    void LightingArea::invalidateStatic(){
+        m_staticDirty = true;
+    }
+    
+    void LightingArea::invalidateStatic(const sf::FloatRect& rect){
+        for(auto light: m_staticLights){
+            if(light->getGlobalBounds().intersects(rect)){
+                m_staticDirty = true;
+                return;
+            }
+        }
+    }
+    
+    void LightingArea::drawClipped(const sf::Drawable& d, const sf::FloatRect* bounds){
+        sf::RenderStates fogrs;
+        fogrs.blendMode = l_substractAlpha;
+        fogrs.transform = getFogTransform();
+        if(!m_clipping){
+            m_renderTexture.draw(d, fogrs);
+            CANDLE_PROFILE_COUNT(drawCalls, 1);
+            CANDLE_PROFILE_COUNT(pixels, bounds != nullptr
+                ? pixelCount(fogrs.transform.transformRect(*bounds), m_renderTexture.getSize())
+                : m_renderTexture.getSize().x * m_renderTexture.getSize().y);
+            return;
+        }
+        sf::FloatRect local;
+        if(bounds != nullptr){
+            local = fogrs.transform.transformRect(*bounds);
+        }
+        for(auto& rect: m_dirtyRects){
+            if(bounds == nullptr || local.intersects(sf::FloatRect(rect))){
+                m_renderTexture.setView(getClipView(rect));
+                m_renderTexture.draw(d, fogrs);
+                CANDLE_PROFILE_COUNT(drawCalls, 1);
+                CANDLE_PROFILE_COUNT(pixels, rect.width * rect.height);
+            }
+        }
+        m_renderTexture.setView(m_renderTexture.getDefaultView());
     }
     
     void LightingArea::setAreaColor(sf::Color c){
         m_color = c;
         sfu::setColor(m_baseTextureQuad, getActualColor());
+        m_fullyDirty = true;
     }
     
     sf::Color LightingArea::getAreaColor() const{
@@ -97,6 +348,7 @@ namespace candle{
     void LightingArea::setAreaOpacity(float o){
         m_opacity = o;
         sfu::setColor(m_baseTextureQuad, getActualColor());
+        m_fullyDirty = true;
     }
     
     float LightingArea::getAreaOpacity() const{
@@ -104,11 +356,17 @@ namespace candle{
     }
     
     void LightingArea::draw(const LightSource& light){
+        CANDLE_PROFILE_SCOPE(AREA_DRAW, this);
         if(m_opacity > 0.f && m_mode == FOG){
-            sf::RenderStates fogrs;
-            fogrs.blendMode = l_substractAlpha;
-            fogrs.transform *= Transformable::getTransform().getInverse();
-            m_renderTexture.draw(light, fogrs);
+            sf::FloatRect bounds = light.getGlobalBounds();
+            drawClipped(light, &bounds);
+        }
+    }
+    
+    void LightingArea::draw(const LightBatch& batch){
+        CANDLE_PROFILE_SCOPE(AREA_DRAW, this);
+        if(m_opacity > 0.f && m_mode == FOG){
+            drawClipped(batch, nullptr);
         }
     }
     
@@ -131,6 +389,7 @@ namespace candle{
         m_baseTextureQuad[1].texCoords = sf::Vector2f(rect.left + rect.width, rect.top);
         m_baseTextureQuad[2].texCoords = sf::Vector2f(rect.left + rect.width, rect.top + rect.height);
         m_baseTextureQuad[3].texCoords = sf::Vector2f(rect.left, rect.top + rect.height);
+        m_fullyDirty = true;
     }
     
     sf::IntRect LightingArea::getTextureRect() const{
@@ -139,13 +398,30 @@ namespace candle{
     
     void LightingArea::setMode(Mode mode){
         m_mode = mode;
+        m_fullyDirty = true;
     }
     
     LightingArea::Mode LightingArea::getMode() const{
         return m_mode;
     }
     
+    void LightingArea::setResolutionScale(float scale){
+        // Written so that NaN is ignored as well
+        if(!(scale > 0.f)){
+            return;
+        }
+        m_resolutionScale = std::min(scale, 1.f);
+        initializeRenderTexture(m_size);
+    }
+    
+    float LightingArea::getResolutionScale() const{
+        return m_resolutionScale;
+    }
+    
     void LightingArea::display(){
+        CANDLE_PROFILE_SCOPE(AREA_DISPLAY, this);
         m_renderTexture.display();
+        m_dirtyRects.clear();
+        m_clipping = false;
     }
 }
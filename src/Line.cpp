@@ -66,22 +66,21 @@ namespace sfu{
         auto& b = l.m_origin;
         auto& w = l.m_direction;
 
-        float th = angle(v, w);
-        if(th < 0.001f || th > 359.99f){
-            if(relativePosition(a) == 0){
+        sf::Vector2f d = b - a;
+        float den = v.x*w.y - v.y*w.x;
+        float vv = v.x*v.x + v.y*v.y;
+        if(den*den <= PARALLEL_EPSILON*PARALLEL_EPSILON * vv * (w.x*w.x + w.y*w.y)){
+            // Same test with the vector between the origins
+            float dv = d.x*v.y - d.y*v.x;
+            if(dv*dv <= PARALLEL_EPSILON*PARALLEL_EPSILON * vv * (d.x*d.x + d.y*d.y)){
                 return COINCIDENTIAL;
             }else{
                 return PARALLEL;
             }
         }
 
-        if(std::abs(w.y) < 0.001f){
-            t1 = (b.y-a.y) / v.y;
-            t2 = (a.x + t1*v.x - b.x) / w.x;
-        }else{
-            t1 = (w.y * (b.x-a.x) + w.x * (a.y-b.y)) / (v.x*w.y - v.y*w.x);
-            t2 = (t1*v.y + a.y - b.y) / w.y;
-        }
+        t1 = (d.x*w.y - d.y*w.x) / den;
+        t2 = (d.x*v.y - d.y*v.x) / den;
 
         return SECANT;
     }
@@ -0,0 +1,223 @@
+#include "Candle/Occluder.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Candle/Stats.hpp"
+#include "Candle/geometry/Vector2.hpp"
+
+namespace candle{
+    namespace{
+        // Maximum distance between the arc of a circle and the rays casted
+        // to it, without a level of detail
+        const float ARC_TOLERANCE = .5f;
+        // Maximum number of pieces of the arc of a circle
+        const unsigned int MAX_ARC_PIECES = 32;
+    }
+
+    ConvexPolygon::ConvexPolygon()
+        : m_radius(0.f)
+        {}
+
+    ConvexPolygon::ConvexPolygon(const sf::Vector2f* points, unsigned int n)
+        : m_points(points, points + n)
+        , m_radius(0.f)
+        {
+        float area = 0.f;
+        for(unsigned int i = 0; i < n; i++){
+            const sf::Vector2f& a = m_points[i];
+            const sf::Vector2f& b = m_points[(i+1) % n];
+            area += a.x * b.y - a.y * b.x;
+            m_center += m_points[i];
+        }
+        if(area < 0.f){
+            std::reverse(m_points.begin(), m_points.end());
+        }
+        if(n > 0){
+            m_center /= (float)n;
+        }
+        for(const sf::Vector2f& p: m_points){
+            m_radius = std::max(m_radius, sfu::magnitude(p - m_center));
+        }
+    }
+
+    ConvexPolygon::ConvexPolygon(const sf::FloatRect& rect, const sf::Transform& transform)
+        : ConvexPolygon()
+        {
+        sf::Vector2f points[4] = {
+            transform.transformPoint(rect.left, rect.top),
+            transform.transformPoint(rect.left + rect.width, rect.top),
+            transform.transformPoint(rect.left + rect.width, rect.top + rect.height),
+            transform.transformPoint(rect.left, rect.top + rect.height)
+        };
+        *this = ConvexPolygon(points, 4);
+    }
+
+    const std::vector<sf::Vector2f>& ConvexPolygon::getPoints() const{
+        return m_points;
+    }
+
+    void ConvexPolygon::getBoundingCircle(sf::Vector2f& center, float& radius) const{
+        center = m_center;
+        radius = m_radius;
+    }
+
+    OccluderList::OccluderList()
+        : m_version(newEdgeVersion())
+        {}
+
+    void OccluderList::clear(){
+        m_circles.clear();
+        m_polygons.clear();
+        m_version = newEdgeVersion();
+    }
+
+    unsigned int OccluderList::addCircle(const Circle& circle){
+        m_circles.push_back(circle);
+        m_version = newEdgeVersion();
+        return m_circles.size() - 1;
+    }
+
+    void OccluderList::setCircle(unsigned int i, const Circle& circle){
+        m_circles[i] = circle;
+        m_version = newEdgeVersion();
+    }
+
+    unsigned int OccluderList::addPolygon(const ConvexPolygon& polygon){
+        m_polygons.push_back(polygon);
+        m_version = newEdgeVersion();
+        return m_polygons.size() - 1;
+    }
+
+    void OccluderList::setPolygon(unsigned int i, const ConvexPolygon& polygon){
+        m_polygons[i] = polygon;
+        m_version = newEdgeVersion();
+    }
+
+    const std::vector<Circle>& OccluderList::getCircles() const{
+        return m_circles;
+    }
+
+    const std::vector<ConvexPolygon>& OccluderList::getPolygons() const{
+        return m_polygons;
+    }
+
+    unsigned long OccluderList::getVersion() const{
+        return m_version;
+    }
+
+    bool OccluderList::contains(unsigned int id, const sf::Vector2f& point) const{
+        if(id < m_circles.size()){
+            sf::Vector2f d = point - m_circles[id].center;
+            return sfu::dot(d, d) <= m_circles[id].radius * m_circles[id].radius;
+        }
+        const std::vector<sf::Vector2f>& points = m_polygons[id - m_circles.size()].m_points;
+        for(unsigned int i = 0; i < points.size(); i++){
+            const sf::Vector2f& a = points[i];
+            const sf::Vector2f& b = points[(i+1) % points.size()];
+            if(crossProduct(b - a, point - a) < 0.f){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void OccluderList::query(const sf::FloatRect& bounds, const sf::Vector2f* outside, std::vector<unsigned int>& ids) const{
+        auto inBounds = [&](const sf::Vector2f& center, float radius){
+            return center.x + radius >= bounds.left && center.x - radius <= bounds.left + bounds.width
+                && center.y + radius >= bounds.top && center.y - radius <= bounds.top + bounds.height;
+        };
+        ids.clear();
+        unsigned int n = m_circles.size();
+        for(unsigned int i = 0; i < n; i++){
+            if(m_circles[i].radius > 0.f && inBounds(m_circles[i].center, m_circles[i].radius)){
+                ids.push_back(i);
+            }
+        }
+        for(unsigned int i = 0; i < m_polygons.size(); i++){
+            const ConvexPolygon& polygon = m_polygons[i];
+            if(polygon.m_points.size() >= 3 && inBounds(polygon.m_center, polygon.m_radius)){
+                ids.push_back(n + i);
+            }
+        }
+        if(outside){
+            ids.erase(std::remove_if(ids.begin(), ids.end(), [&](unsigned int id){
+                return contains(id, *outside);
+            }), ids.end());
+        }
+    }
+
+    void OccluderList::getArc(const Circle& c, const sf::Vector2f& source, bool directional, float tolerance, sf::Vector2f& toSource, float& half, unsigned int& pieces){
+        if(directional){
+            toSource = -sfu::normalize(source);
+            half = sfu::PI/2;
+        }else{
+            sf::Vector2f d = source - c.center;
+            float distance = sfu::magnitude(d);
+            toSource = d / distance;
+            half = std::acos(std::min(1.f, c.radius / distance));
+        }
+        if(tolerance <= 0.f){
+            tolerance = ARC_TOLERANCE;
+        }
+        // The chord of the angle step is within the tolerance of the arc
+        float step = 2 * std::acos(std::max(-1.f, 1.f - tolerance / c.radius));
+        unsigned int n = (unsigned int)std::ceil(2 * half / step);
+        pieces = std::max(1u, std::min(n, MAX_ARC_PIECES));
+    }
+
+    bool OccluderList::castRay(const std::vector<unsigned int>& ids, const sfu::Line& ray, float& distance) const{
+        CANDLE_PROFILE_COUNT(intersectionTests, ids.size());
+        const sf::Vector2f& o = ray.m_origin;
+        sf::Vector2f u = sfu::normalize(ray.m_direction);
+        bool hit = false;
+        for(unsigned int id: ids){
+            if(id < m_circles.size()){
+                const Circle& c = m_circles[id];
+                sf::Vector2f m = o - c.center;
+                float b = sfu::dot(m, u);
+                float k = sfu::dot(m, m) - c.radius * c.radius;
+                float disc = b * b - k;
+                if((k > 0.f && b > 0.f) || disc < 0.f){
+                    continue;
+                }
+                float t = std::max(0.f, -b - std::sqrt(disc));
+                if(t < distance){
+                    distance = t;
+                    hit = true;
+                }
+                continue;
+            }
+            // The ray enters the polygon when it is on the inner side of all
+            // the edges
+            const ConvexPolygon& polygon = m_polygons[id - m_circles.size()];
+            sf::Vector2f m = o - polygon.m_center;
+            float b = sfu::dot(m, u);
+            if(sfu::dot(m, m) - b * b > polygon.m_radius * polygon.m_radius){
+                continue;
+            }
+            const std::vector<sf::Vector2f>& points = polygon.m_points;
+            float enter = 0.f, exit = distance;
+            for(unsigned int i = 0; i < points.size() && enter <= exit; i++){
+                const sf::Vector2f& a = points[i];
+                sf::Vector2f e = points[(i+1) % points.size()] - a;
+                float num = crossProduct(e, o - a);
+                float den = crossProduct(e, u);
+                if(den == 0.f){
+                    if(num < 0.f){
+                        exit = -1.f;
+                    }
+                }else if(den > 0.f){
+                    enter = std::max(enter, -num / den);
+                }else{
+                    exit = std::min(exit, -num / den);
+                }
+            }
+            if(enter <= exit && enter < distance){
+                distance = enter;
+                hit = true;
+            }
+        }
+        return hit;
+    }
+}
@@ -3,20 +3,38 @@
 #endif
 
 #include <memory>
+#include <set>
+#include <limits>
+#include <algorithm>
 #include "Candle/RadialLight.hpp"
 
 #include "SFML/Graphics.hpp"
 
+#include "Candle/EdgeIndex.hpp"
+#include "Candle/EdgeBuffer.hpp"
+#include "Candle/EdgeMesh.hpp"
+#include "Candle/Occluder.hpp"
+#include "Candle/CastScratch.hpp"
+#include "Candle/Stats.hpp"
 #include "Candle/graphics/VertexArray.hpp"
 #include "Candle/geometry/Vector2.hpp"
 #include "Candle/geometry/Line.hpp"
 
+#ifndef CANDLE_FALLOFF
+#define CANDLE_FALLOFF TEXTURE
+#endif
+
 namespace candle{
     int RadialLight::s_instanceCount = 0;
+    RadialLight::Falloff RadialLight::s_falloff = RadialLight::CANDLE_FALLOFF;
     const float BASE_RADIUS = 400.0f;
     bool l_texturesReady(false);
     std::unique_ptr<sf::RenderTexture> l_lightTextureFade;
     std::unique_ptr<sf::RenderTexture> l_lightTexturePlain;
+    bool l_shadersReady(false);
+    std::unique_ptr<sf::Shader> l_falloffShaderFade;
+    std::unique_ptr<sf::Shader> l_falloffShaderPlain;
+    std::string l_customFalloff("return 1.0 - d;");
 
     void initializeTextures(){
         #ifdef CANDLE_DEBUG
@@ -49,22 +67,139 @@ namespace candle{
         l_lightTexturePlain->draw(lightShape);
         l_lightTexturePlain->display();
         l_lightTexturePlain->setSmooth(true);
+        l_texturesReady = true;
     }
 
-    float module360(float x){
-        x = (float)fmod(x,360.f);
-        if(x < 0.f) x += 360.f;
-        return x;
+    namespace{
+        const char* falloffFunction(RadialLight::Falloff falloff){
+            switch(falloff){
+            case RadialLight::QUADRATIC:
+                return "return (1.0 - d) * (1.0 - d);";
+            case RadialLight::SMOOTH:
+                return "return 1.0 - smoothstep(0.0, 1.0, d);";
+            case RadialLight::CUSTOM:
+                return l_customFalloff.c_str();
+            default:
+                return "return 1.0 - d;";
+            }
+        }
+
+        bool loadFalloffShader(std::unique_ptr<sf::Shader>& shader, const std::string& function){
+            // The texture coordinates of the polygon are its local positions,
+            // and they are not normalized because the lights have no texture
+            const std::string source =
+                "uniform vec2 center;\n"
+                "uniform float radius;\n"
+                "float falloff(float d){\n" + function + "\n}\n"
+                "void main(){\n"
+                "    float d = length(gl_TexCoord[0].xy - center) / radius;\n"
+                "    float a = d < 1.0 ? clamp(falloff(d), 0.0, 1.0) : 0.0;\n"
+                "    gl_FragColor = vec4(gl_Color.rgb, gl_Color.a * a);\n"
+                "}\n";
+            std::unique_ptr<sf::Shader> s(new sf::Shader);
+            if(!s->loadFromMemory(source, sf::Shader::Fragment)){
+                return false;
+            }
+            s->setUniform("center", sf::Glsl::Vec2(BASE_RADIUS, BASE_RADIUS));
+            s->setUniform("radius", BASE_RADIUS);
+            shader = std::move(s);
+            return true;
+        }
+
+        // Same curves as the shaders, for the code that runs on the CPU. A
+        // custom one can't be evaluated here, so it is taken as linear
+        float falloffCurve(RadialLight::Falloff falloff, float d){
+            switch(falloff){
+            case RadialLight::QUADRATIC:
+                return (1.f - d) * (1.f - d);
+            case RadialLight::SMOOTH:
+                return 1.f - d * d * (3.f - 2.f * d);
+            default:
+                return 1.f - d;
+            }
+        }
+
+        float module360(float x){
+            x = (float)fmod(x,360.f);
+            if(x < 0.f) x += 360.f;
+            return x;
+        }
+
+        // Visits both ends of the edges, as the vertices for
+        // RadialLight::castLightRays, with the three rays for each one. The
+        // edges out of range are already dropped by the casts.
+        template <typename EdgeVisitor>
+        struct EdgeEnds{
+            EdgeVisitor forEachEdge;
+            float lodTolerance;
+
+            template <typename VertexFunction>
+            void operator()(const VertexFunction& f) const{
+                forEachEdge([&](const sfu::Line& s){
+                    if(lodTolerance > 0.f && sfu::magnitude(s.m_direction) < lodTolerance){
+                        return;
+                    }
+                    f(s.m_origin, 7);
+                    f(s.point(1.f), 7);
+                });
+            }
+        };
+
+        template <typename EdgeVisitor>
+        EdgeEnds<EdgeVisitor> edgeEnds(const EdgeVisitor& forEachEdge, float lodTolerance){
+            return EdgeEnds<EdgeVisitor>{forEachEdge, lodTolerance};
+        }
+
+        // The visitors of the casts are templates instead of std::function,
+        // so that the work done for each edge and vertex can be inlined.
+        // An EdgeList visits the edges given by get(0) to get(count - 1).
+        template <typename EdgeGetter>
+        struct EdgeList{
+            unsigned int count;
+            EdgeGetter get;
+
+            template <typename EdgeFunction>
+            void operator()(const EdgeFunction& f) const{
+                for(unsigned int i = 0; i < count; i++){
+                    f(get(i));
+                }
+            }
+        };
+
+        template <typename EdgeGetter>
+        EdgeList<EdgeGetter> edgeList(unsigned int count, const EdgeGetter& get){
+            return EdgeList<EdgeGetter>{count, get};
+        }
+
+        // Visits the vertices of a mesh with the rays that pick(vertex)
+        // returns for each one, leaving out the ones without rays
+        template <typename RayPicker>
+        struct PickedVertices{
+            const std::vector<unsigned int>& ids;
+            const std::vector<sf::Vector2f>& vertices;
+            RayPicker pick;
+
+            template <typename VertexFunction>
+            void operator()(const VertexFunction& f) const{
+                for(unsigned int v: ids){
+                    int rays = pick(v);
+                    if(rays){
+                        f(vertices[v], rays);
+                    }
+                }
+            }
+        };
+
+        template <typename RayPicker>
+        PickedVertices<RayPicker> pickedVertices(const std::vector<unsigned int>& ids, const std::vector<sf::Vector2f>& vertices, const RayPicker& pick){
+            return PickedVertices<RayPicker>{ids, vertices, pick};
+        }
     }
 
     RadialLight::RadialLight()
         : LightSource()
+        , m_castAlgorithm(RAYCAST)
         {
-        if(!l_texturesReady){
-            // The first time we create a RadialLight, we must create the textures
-            initializeTextures();
-            l_texturesReady = true;
-        }
         m_polygon.setPrimitiveType(sf::TriangleFan);
         m_polygon.resize(6);
         m_polygon[0].position =
@@ -100,18 +235,27 @@ namespace candle{
             std::cout << "RadialLight: Textures destroyed" << std::endl;
             #endif
         }
+        if (s_instanceCount == 0 && l_shadersReady)
+        {
+            // They are compiled again when needed, with the same falloff
+            l_falloffShaderFade.reset(nullptr);
+            l_falloffShaderPlain.reset(nullptr);
+            l_shadersReady = false;
+        }
         #endif
     }
 
     void RadialLight::draw(sf::RenderTarget& t, sf::RenderStates s) const{
-        sf::Transform trm = Transformable::getTransform();
-        trm.scale(m_range/BASE_RADIUS, m_range/BASE_RADIUS, BASE_RADIUS, BASE_RADIUS);
-        s.transform *= trm;
-        s.texture = m_fade ? &l_lightTextureFade->getTexture() : &l_lightTexturePlain->getTexture();
+        drawLight(t, s, m_fade);
+    }
+
+    void RadialLight::drawLight(sf::RenderTarget& t, sf::RenderStates s, bool fade) const{
+        s.transform *= getFrontTransform();
+        setLightStates(s, fade);
         if(s.blendMode == sf::BlendAlpha){
             s.blendMode = sf::BlendAdd;
         }
-        t.draw(m_polygon, s);
+        drawPolygon(t, s);
 #ifdef CANDLE_DEBUG
         sf::RenderStates deb_s;
         deb_s.transform = s.transform;
@@ -119,121 +263,757 @@ namespace candle{
 #endif
     }
     void RadialLight::resetColor(){
-        sfu::setColor(m_polygon, m_color);
+        sfu::setColor(getLatestPolygon(), m_color);
+        latestPolygonChanged();
+    }
+
+    sf::Transform RadialLight::getPolygonTransform() const{
+        sf::Transform trm = Transformable::getTransform();
+        trm.scale(m_range/BASE_RADIUS, m_range/BASE_RADIUS, BASE_RADIUS, BASE_RADIUS);
+        return trm;
+    }
+
+    void RadialLight::setLightStates(sf::RenderStates& s, bool fade){
+        if(s_falloff != TEXTURE && (l_shadersReady || setFalloff(s_falloff))){
+            s.texture = nullptr;
+            s.shader = fade ? l_falloffShaderFade.get() : l_falloffShaderPlain.get();
+            return;
+        }
+        if(!l_texturesReady){
+            // The first time we draw a RadialLight, we must create the textures
+            initializeTextures();
+        }
+        s.texture = fade ? &l_lightTextureFade->getTexture() : &l_lightTexturePlain->getTexture();
+    }
+
+    bool RadialLight::setFalloff(Falloff falloff){
+        s_falloff = falloff;
+        l_shadersReady = false;
+        if(falloff == TEXTURE){
+            l_falloffShaderFade.reset(nullptr);
+            l_falloffShaderPlain.reset(nullptr);
+            return true;
+        }
+        l_shadersReady = sf::Shader::isAvailable()
+            && loadFalloffShader(l_falloffShaderFade, falloffFunction(falloff))
+            && loadFalloffShader(l_falloffShaderPlain, "return 1.0;");
+        if(!l_shadersReady){
+            s_falloff = TEXTURE;
+        }
+        return l_shadersReady;
+    }
+
+    RadialLight::Falloff RadialLight::getFalloff(){
+        return s_falloff;
+    }
+
+    bool RadialLight::setFalloffFunction(const std::string& function){
+        l_customFalloff = function;
+        return setFalloff(CUSTOM);
+    }
+
+    std::size_t RadialLight::countTriangleVertices(const sf::VertexArray& polygon) const{
+        std::size_t n = polygon.getVertexCount();
+        return n < 3 ? 0 : (n - 2) * 3;
+    }
+
+    void RadialLight::writeTriangles(const sf::VertexArray& polygon, const sf::Transform& transform, sf::Vertex* triangles) const{
+        unsigned int n = polygon.getVertexCount();
+        if(n < 3){
+            return;
+        }
+        // The transform is applied to the positions only, since the texture
+        // coordinates are the local positions
+        sf::Vertex center = polygon[0];
+        center.position = transform.transformPoint(center.position);
+        sf::Vertex previous = polygon[1];
+        previous.position = transform.transformPoint(previous.position);
+        for(unsigned int i = 2; i < n; i++){
+            sf::Vertex current = polygon[i];
+            current.position = transform.transformPoint(current.position);
+            *triangles++ = center;
+            *triangles++ = previous;
+            *triangles++ = current;
+            previous = current;
+        }
     }
 
     void RadialLight::setBeamAngle(float r){
         m_beamAngle = module360(r);
+        m_castDirty = true;
     }
 
     float RadialLight::getBeamAngle() const{
         return m_beamAngle;
-    }
-
-    sf::FloatRect RadialLight::getLocalBounds() const{
-        return sf::FloatRect(0.0f, 0.0f, m_range*4, m_range*4);
-    }
-
-    sf::FloatRect RadialLight::getGlobalBounds() const{
-        float scaledRange = m_range / BASE_RADIUS;
-        sf::Transform trm = Transformable::getTransform();
-        trm.scale(scaledRange, scaledRange, BASE_RADIUS, BASE_RADIUS);
-        return trm.transformRect( getLocalBounds() );
+    }
+
+    void RadialLight::setCastAlgorithm(CastAlgorithm algorithm){
+        m_castAlgorithm = algorithm;
+        m_castDirty = true;
+    }
+
+    RadialLight::CastAlgorithm RadialLight::getCastAlgorithm() const{
+        return m_castAlgorithm;
+    }
+
+    float RadialLight::getIntensityAt(const sf::Vector2f& point, sf::Vector2f& source) const{
+        source = Transformable::getPosition();
+        sf::Vector2f d = point - source;
+        float distance = sfu::magnitude(d);
+        if(distance > m_range){
+            return 0.f;
+        }
+        bool beamAngleBigEnough = m_beamAngle < 0.1f;
+        if(!beamAngleBigEnough && distance > 0.f){
+            float bl1 = module360(getRotation() - m_beamAngle/2);
+            if(module360(sfu::angle(d) - bl1) > m_beamAngle){
+                return 0.f;
+            }
+        }
+        return getIntensity() * (m_fade ? falloffCurve(s_falloff, distance / m_range) : 1.f);
+    }
+
+    float RadialLight::getFalloffAt(const sf::Vector2f& texCoords) const{
+        // Same as the textures and shaders, centered in the local center
+        float d = sfu::magnitude(texCoords - sf::Vector2f(BASE_RADIUS, BASE_RADIUS)) / BASE_RADIUS;
+        if(d >= 1.f){
+            return 0.f;
+        }
+        return m_fade ? falloffCurve(s_falloff, d) : 1.f;
+    }
+
+    bool RadialLight::getFalloffCircle(sf::Vector2f& center, float& radius) const{
+        center = sf::Vector2f(BASE_RADIUS, BASE_RADIUS);
+        radius = BASE_RADIUS;
+        return true;
+    }
+
+    sf::FloatRect RadialLight::getLocalBounds() const{
+        return sf::FloatRect(0.0f, 0.0f, BASE_RADIUS*2, BASE_RADIUS*2);
+    }
+
+    sf::FloatRect RadialLight::getGlobalBounds() const{
+        // The front transform has the range of the cast, and doesn't change
+        // while a CastPipeline casts the light in another thread
+        return getFrontTransform().transformRect( getLocalBounds() );
+    }
+
+    sf::FloatRect RadialLight::getCastBounds() const{
+        return getPolygonTransform().transformRect( getLocalBounds() );
     }
 
     void RadialLight::castLight(const EdgeVector::iterator& begin, const EdgeVector::iterator& end){
-        float scaledRange = m_range / BASE_RADIUS;
-        sf::Transform trm = Transformable::getTransform();
-        trm.scale(scaledRange, scaledRange, BASE_RADIUS, BASE_RADIUS);
-        std::vector<sfu::Line> rays;
+        castLightWith<AnyBeam>(begin, end);
+    }
+
+    void RadialLight::castLight(const EdgeIndex& index){
+        castLightIndex<AnyBeam>(index, nullptr);
+    }
+
+    void RadialLight::castLight(const EdgeBuffer& edges){
+        castLightWith<AnyBeam>(edges);
+    }
+
+    void RadialLight::castLight(const EdgeMesh& mesh){
+        castLightWith<AnyBeam>(mesh);
+    }
+
+    bool RadialLight::castLightChanges(const EdgeIndex& index, const std::vector<EdgeChange>& changes){
+        return castLightChangesWith<AnyBeam>(index, changes);
+    }
+
+    template <typename Beam>
+    void RadialLight::castLightWith(const EdgeVector::iterator& begin, const EdgeVector::iterator& end){
+        CANDLE_PROFILE_SCOPE(CAST_LIGHT, this);
+        CastScratch& scratch = castScratch();
+        scratch.beginCast();
+        // The edges out of range can't be seen, so they are dropped once
+        // and the rays only test the rest, as with an EdgeIndex
+        std::vector<sfu::Line>& edges = scratch.m_edges;
+        edges.clear();
+        auto castPoint = Transformable::getPosition();
+        for(auto it = begin; it != end; it++){
+            if(sfu::segmentInCircle(*it, castPoint, m_range)){
+                edges.push_back(*it);
+            }
+        }
+        CANDLE_PROFILE_COUNT(edges, end - begin);
+        CANDLE_PROFILE_COUNT(culledEdges, (end - begin) - edges.size());
+        auto forEachEdge = edgeList(edges.size(), [&](unsigned int i)-> const sfu::Line& {
+            return edges[i];
+        });
+        if(m_castAlgorithm == SWEEP){
+            castLightSweep<Beam>(forEachEdge);
+        }else{
+            castLightRays<Beam>(
+                edgeEnds(forEachEdge, m_lodTolerance),
+                [&](const sfu::Line& r){
+                    CANDLE_PROFILE_COUNT(intersectionTests, edges.size());
+                    return sfu::castRay(edges.begin(), edges.end(), r, m_range*m_range);
+                });
+        }
+        scratch.endCast();
+    }
+
+    template <typename Beam>
+    bool RadialLight::castLightChangesWith(const EdgeIndex& index, const std::vector<EdgeChange>& changes){
+        // Only the rays in the directions of the old and new edges may change
+        sf::FloatRect lightBounds = getCastBounds();
+        auto castPoint = Transformable::getPosition();
+        float bl1 = module360(getRotation() - m_beamAngle/2);
+        // Wider than the rays casted around the ends of the edges
+        float margin = .01f;
+        bool full = false;
+        CastScratch& scratch = castScratch();
+        scratch.beginCast();
+        std::vector<AngleRange>& window = scratch.m_window;
+        window.clear();
+        auto addEdge = [&](const sfu::Line& s){
+            if( !lightBounds.intersects( s.getGlobalBounds() ) ){
+                return;
+            }
+            sf::Vector2f d1 = s.m_origin - castPoint;
+            sf::Vector2f d2 = s.point(1.f) - castPoint;
+            if(d1.x * d2.y - d1.y * d2.x == 0.f && sfu::dot(d1, d2) <= 0.f){
+                full = true; // the edge passes through the light
+                return;
+            }
+            float a1 = sfu::angle(d1);
+            float width = module360(sfu::angle(d2) - a1);
+            if(width > 180.f){
+                a1 += width;
+                width = 360.f - width;
+            }
+            window.push_back({module360(a1 - margin - bl1), width + 2*margin});
+        };
+        for(auto& c: changes){
+            addEdge(c.before);
+            addEdge(c.after);
+        }
+        scratch.endCast();
+        if(window.empty() && !full){
+            return false;
+        }
+        if(full || m_castAlgorithm != RAYCAST || m_hits.empty()){
+            castLightIndex<Beam>(index, nullptr);
+        }else{
+            castLightIndex<Beam>(index, &window);
+        }
+        return true;
+    }
 
-        rays.reserve(2 + std::distance(begin, end) * 2 * 3); // 2: beam angle, 4: corners, 2: pnts/sgmnt, 3 rays/pnt
+    template <typename Beam>
+    void RadialLight::castLightIndex(const EdgeIndex& index, const std::vector<AngleRange>* window){
+        CANDLE_PROFILE_SCOPE(CAST_LIGHT, this);
+        CastScratch& scratch = castScratch();
+        scratch.beginCast();
+        // The query returns the edges of the cells that the bounds of the
+        // light cross, and the ones that don't reach its circle are dropped
+        std::vector<unsigned int>& ids = scratch.m_ids;
+        index.query(getCastBounds(), ids);
+        CANDLE_PROFILE_COUNT(edges, ids.size());
+        const EdgeVector& edges = index.getEdges();
+        auto castPoint = Transformable::getPosition();
+        std::size_t queried = ids.size();
+        ids.erase(std::remove_if(ids.begin(), ids.end(), [&](unsigned int id){
+            return !sfu::segmentInCircle(edges[id], castPoint, m_range);
+        }), ids.end());
+        CANDLE_PROFILE_COUNT(culledEdges, queried - ids.size());
+        auto forEachEdge = edgeList(ids.size(), [&](unsigned int i)-> const sfu::Line& {
+            return edges[ids[i]];
+        });
+        if(m_castAlgorithm == SWEEP){
+            castLightSweep<Beam>(forEachEdge);
+        }else{
+            castLightRays<Beam>(
+                edgeEnds(forEachEdge, m_lodTolerance),
+                [&](const sfu::Line& r){
+                    // Edges out of range can't be seen, so the walk stops there
+                    float t;
+                    if(!index.castRay(r, m_range, t)){
+                        t = m_range*m_range;
+                    }
+                    return r.m_origin + t * sfu::normalize(r.m_direction);
+                },
+                window);
+        }
+        scratch.endCast();
+    }
+
+    template <typename Beam>
+    void RadialLight::castLightWith(const EdgeBuffer& edges){
+        CANDLE_PROFILE_SCOPE(CAST_LIGHT, this);
+        CastScratch& scratch = castScratch();
+        scratch.beginCast();
+        CANDLE_PROFILE_COUNT(edges, edges.size());
+        // Only the edges in range get rays, but the rays are still
+        // tested against the whole buffer
+        std::vector<unsigned int>& ids = scratch.m_ids;
+        ids.clear();
+        auto castPoint = Transformable::getPosition();
+        for(unsigned int i = 0; i < edges.size(); i++){
+            if(sfu::segmentInCircle(edges.getEdge(i), castPoint, m_range)){
+                ids.push_back(i);
+            }
+        }
+        CANDLE_PROFILE_COUNT(culledEdges, edges.size() - ids.size());
+        auto forEachEdge = edgeList(ids.size(), [&](unsigned int i){
+            return edges.getEdge(ids[i]);
+        });
+        if(m_castAlgorithm == SWEEP){
+            castLightSweep<Beam>(forEachEdge);
+        }else{
+            castLightRays<Beam>(
+                edgeEnds(forEachEdge, m_lodTolerance),
+                [&](const sfu::Line& r){
+                    CANDLE_PROFILE_COUNT(intersectionTests, edges.size());
+                    return candle::castRay(edges, r, m_range*m_range);
+                });
+        }
+        scratch.endCast();
+    }
+
+    template <typename Beam>
+    void RadialLight::castLightWith(const EdgeMesh& mesh){
+        CANDLE_PROFILE_SCOPE(CAST_LIGHT, this);
+        CastScratch& scratch = castScratch();
+        scratch.beginCast();
+        // The segments in range are tested by the rays, and their vertices
+        // are the ones the rays are casted to
+        const EdgeVector& meshEdges = mesh.getEdges();
+        const std::vector<EdgeMesh::Segment>& segments = mesh.getSegments();
+        const std::vector<sf::Vector2f>& vertices = mesh.getVertices();
+        std::vector<sfu::Line>& edges = scratch.m_edges;
+        std::vector<unsigned int>& ids = scratch.m_ids;
+        edges.clear();
+        ids.clear();
+        auto castPoint = Transformable::getPosition();
+        for(unsigned int i = 0; i < meshEdges.size(); i++){
+            if(sfu::segmentInCircle(meshEdges[i], castPoint, m_range)){
+                edges.push_back(meshEdges[i]);
+                ids.push_back(segments[i].a);
+                ids.push_back(segments[i].b);
+            }
+        }
+        CANDLE_PROFILE_COUNT(edges, meshEdges.size());
+        CANDLE_PROFILE_COUNT(culledEdges, meshEdges.size() - edges.size());
+        if(m_castAlgorithm == SWEEP){
+            castLightSweep<Beam>(edgeList(edges.size(), [&](unsigned int i)-> const sfu::Line& {
+                return edges[i];
+            }));
+            scratch.endCast();
+            return;
+        }
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        bool lod = m_lodTolerance > 0.f;
+        bool coarse = isCoarseLod(2 * m_range);
+        // Which of the rays around a vertex are needed, or 0 if it is hidden
+        // by its own segments
+        auto vertexRays = [&](unsigned int v){
+            const sf::Vector2f& p = vertices[v];
+            sf::Vector2f d = p - castPoint;
+            bool before = false, after = false;
+            bool used = false, visible = false;
+            for(unsigned int i: mesh.getVertexSegments(v)){
+                const EdgeMesh::Segment& s = segments[i];
+                if(lod && sfu::magnitude(meshEdges[i].m_direction) < m_lodTolerance){
+                    continue;
+                }
+                used = true;
+                sf::Vector2f q = vertices[s.a == v ? s.b : s.a];
+                float side = d.x * (q.y - p.y) - d.y * (q.x - p.x);
+                // A ray just past the vertex on the side of a segment hits it
+                after = after || side > 0.f;
+                before = before || side < 0.f;
+                if(s.solidSide == 0){
+                    visible = true;
+                }else{
+                    sf::Vector2f a = vertices[s.a], b = vertices[s.b];
+                    float facing = (b.x - a.x) * (castPoint.y - a.y) - (b.y - a.y) * (castPoint.x - a.x);
+                    visible = visible || facing * s.solidSide < 0.f;
+                }
+            }
+            if(!used || (!visible && !coarse)){
+                return 0;
+            }
+            if(before && after){
+                // The ray to the vertex stops there, or close, on either side
+                return 2;
+            }
+            if(before || after){
+                // The ray on the side of the segments hits them just next to
+                // the vertex, where the one to the vertex could slip through
+                return 5;
+            }
+            return 7;
+        };
+        castLightRays<Beam>(
+            pickedVertices(ids, vertices, vertexRays),
+            [&](const sfu::Line& r){
+                CANDLE_PROFILE_COUNT(intersectionTests, edges.size());
+                return sfu::castRay(edges.begin(), edges.end(), r, m_range*m_range);
+            });
+        scratch.endCast();
+    }
+
+    template <typename Beam, typename VertexVisitor, typename RayCaster>
+    void RadialLight::castLightRays(const VertexVisitor& forEachVertex, const RayCaster& caster, const std::vector<AngleRange>* window){
+        // The rays are stored as two parallel buffers: the angle of each ray
+        // relative to the start of the beam, which is the sort key, and its
+        // direction. The angles are computed once per ray, so sorting only
+        // compares floats, and the relative angle needs no special case when
+        // the beam crosses the 0 degrees direction.
+        //
+        // With a window, only the rays in it are casted, and the others are
+        // taken from the last cast.
+        CastScratch& scratch = castScratch();
+        std::vector<float>& angles = scratch.m_angles;
+        std::vector<sf::Vector2f>& directions = scratch.m_directions;
+        angles.clear();
+        directions.clear();
 
         // Start casting
         float bl1 = module360(getRotation() - m_beamAngle/2);
-        float bl2 = module360(getRotation() + m_beamAngle/2);
-        bool beamAngleBigEnough = m_beamAngle < 0.1f;
+        // Known at compile time for a FullCircle, that skips the checks
+        bool beamAngleBigEnough = !Beam::isLimited(m_beamAngle);
+        float span = beamAngleBigEnough ? 360.f : m_beamAngle;
         auto castPoint = Transformable::getPosition();
         float off = .001f;
+        // With a coarse level of detail, rays closer than this angle are
+        // merged
+        float lodAngle = m_lodTolerance / m_range * 180.f/sfu::PI;
+        bool coarse = isCoarseLod(2 * m_range);
 
-        auto angleInBeam = [&](float a)-> bool {
-            return beamAngleBigEnough
-                   ||(bl1 < bl2 && a > bl1 && a < bl2)
-                   ||(bl1 > bl2 && (a > bl1 || a < bl2));
+        // The occluders in range are tested after the edges by every ray
+        std::vector<unsigned int>& occluders = scratch.m_occluders;
+        occluders.clear();
+        if(m_occluders){
+            m_occluders->query(getCastBounds(), &castPoint, occluders);
+        }
+        auto cast = [&](const sfu::Line& r){
+            sf::Vector2f p = caster(r);
+            float distance = sfu::magnitude(p - r.m_origin);
+            if(!occluders.empty() && m_occluders->castRay(occluders, r, distance)){
+                p = r.m_origin + distance * sfu::normalize(r.m_direction);
+            }
+            return p;
         };
 
-        for(float a = 45.f; a < 360.f; a += 90.f){
-            if(beamAngleBigEnough || angleInBeam(a)){
-                rays.emplace_back(castPoint, a);
+        auto inWindow = [&](float rel){
+            if(!window){
+                return true;
             }
+            for(auto& w: *window){
+                if(module360(rel - w.start) <= w.width){
+                    return true;
+                }
+            }
+            return false;
+        };
+        auto inBeam = [&](float rel){
+            return beamAngleBigEnough || (rel > 0.f && rel < span);
+        };
+        auto addRay = [&](float a, const sf::Vector2f& direction){
+            float rel = module360(a - bl1);
+            if(inBeam(rel) && inWindow(rel)){
+                angles.push_back(rel);
+                directions.push_back(direction);
+            }
+        };
+        auto addAngle = [&](float a){
+            float rad = a * sfu::PI/180.f;
+            addRay(a, sf::Vector2f(std::cos(rad), std::sin(rad)));
+        };
+
+        for(float a = 45.f; a < 360.f; a += 90.f){
+            addAngle(a);
         }
-
-        sf::FloatRect lightBounds = getGlobalBounds();
-        for(auto it = begin; it != end; it++){
-            auto& s = *it;
-
-            //Only cast a ray if the line is in range
-            if( lightBounds.intersects( s.getGlobalBounds() ) ){
-                sfu::Line r1(castPoint, s.m_origin);
-                sfu::Line r2(castPoint, s.point(1.f));
-                float a1 = sfu::angle(r1.m_direction);
-                float a2 = sfu::angle(r2.m_direction);
-                if(angleInBeam(a1)){
-                    rays.push_back(r1);
-                    rays.emplace_back(castPoint, a1 - off);
-                    rays.emplace_back(castPoint, a1 + off);
+
+        // The flags tell which rays are needed: 1 for the one just before
+        // the vertex, 2 for the one to it and 4 for the one just after it.
+        // With a coarse level of detail, only the one to the vertex is
+        // casted.
+        auto addVertex = [&](const sf::Vector2f& p, int rays){
+            sf::Vector2f d = p - castPoint;
+            float a = sfu::angle(d);
+            if(inBeam(module360(a - bl1))){
+                if(coarse || (rays & 2)){
+                    addRay(a, d);
                 }
-                if(angleInBeam(a2)){
-                    rays.push_back(r2);
-                    rays.emplace_back(castPoint, a2 - off);
-                    rays.emplace_back(castPoint, a2 + off);
+                if(!coarse){
+                    if(rays & 1){
+                        addAngle(a - off);
+                    }
+                    if(rays & 4){
+                        addAngle(a + off);
+                    }
+                }
+            }
+        };
+        forEachVertex(addVertex);
+        if(!occluders.empty()){
+            m_occluders->visitVertices(occluders, castPoint, false, m_lodTolerance, addVertex);
+        }
+
+        std::vector<unsigned int>& order = scratch.m_order;
+        order.resize(angles.size());
+        for(unsigned int i = 0; i < order.size(); i++){
+            order[i] = i;
+        }
+        std::sort(
+            order.begin(),
+            order.end(),
+            [&angles] (unsigned int i, unsigned int j){
+                return angles[i] < angles[j];
+            }
+        );
+
+        // The limits of the beam are kept with angles 0 and span
+        std::vector<float>& hitAngles = scratch.m_hitAngles;
+        std::vector<sf::Vector2f>& points = scratch.m_points;
+        hitAngles.clear();
+        points.clear();
+        if(!beamAngleBigEnough && inWindow(0.f)){
+            hitAngles.push_back(0.f);
+            points.push_back(cast(sfu::Line(castPoint, bl1)));
+        }
+        sfu::Line ray(castPoint, castPoint);
+        float lastAngle = -lodAngle;
+        for(unsigned int i: order){
+            if(coarse){
+                if(angles[i] - lastAngle < lodAngle){
+                    continue;
                 }
+                lastAngle = angles[i];
             }
+            // castPoint + direction would lose precision far from the origin
+            ray.m_direction = directions[i];
+            hitAngles.push_back(angles[i]);
+            points.push_back(cast(ray));
+        }
+        if(!beamAngleBigEnough && inWindow(span)){
+            hitAngles.push_back(span);
+            points.push_back(cast(sfu::Line(castPoint, bl1 + m_beamAngle)));
         }
+        CANDLE_PROFILE_COUNT(rays, points.size());
 
-        if(bl1 > bl2){
-            std::sort(
-                rays.begin(),
-                rays.end(),
-                [bl1, bl2] (sfu::Line& r1, sfu::Line& r2){
-                    float _bl1 = bl1-0.1;
-                    float _bl2 = bl2+0.1;
-                    float a1 = sfu::angle(r1.m_direction);
-                    float a2 = sfu::angle(r2.m_direction);
-                    return (a1 >= _bl1 && a2 <= _bl2) || (a1 < a2 && (_bl1 <= a1 || a2 <= _bl2));
+        if(window){
+            std::vector<float>& mergedAngles = scratch.m_mergedAngles;
+            std::vector<sf::Vector2f>& merged = scratch.m_merged;
+            mergedAngles.clear();
+            merged.clear();
+            size_t j = 0;
+            for(size_t i = 0; i < m_hitAngles.size(); i++){
+                if(inWindow(m_hitAngles[i])){
+                    continue;
                 }
-            );
+                for(; j < hitAngles.size() && hitAngles[j] < m_hitAngles[i]; j++){
+                    mergedAngles.push_back(hitAngles[j]);
+                    merged.push_back(points[j]);
+                }
+                mergedAngles.push_back(m_hitAngles[i]);
+                merged.push_back(m_hits[i]);
+            }
+            for(; j < hitAngles.size(); j++){
+                mergedAngles.push_back(hitAngles[j]);
+                merged.push_back(points[j]);
+            }
+            m_hitAngles.assign(mergedAngles.begin(), mergedAngles.end());
+            m_hits.assign(merged.begin(), merged.end());
         }else{
-            std::sort(
-                rays.begin(),
-                rays.end(),
-                [bl1] (sfu::Line& r1, sfu::Line& r2){
-                    return
-                        sfu::angle(r1.m_direction) < sfu::angle(r2.m_direction);
+            m_hitAngles.assign(hitAngles.begin(), hitAngles.end());
+            m_hits.assign(points.begin(), points.end());
+        }
+        setPolygon<Beam>(m_hits);
+    }
+
+    namespace{
+        struct SweepSegment{
+            sf::Vector2f a; // end met first by the sweep, relative to the light
+            sf::Vector2f d; // from a to the other end
+        };
+
+        struct SweepEvent{
+            float angle; // relative to the start of the sweep
+            int segment; // -1 for the fixed angles, that only emit a point
+            bool begin;
+            bool operator < (const SweepEvent& e) const{
+                return angle < e.angle;
+            }
+        };
+
+        // Distance along the probe ray to the line of each segment. With
+        // segments that don't intersect, the order only changes at events.
+        struct SweepCloser{
+            const std::vector<SweepSegment>* segments;
+            const sf::Vector2<double>* probe;
+            double distance(int i) const{
+                const SweepSegment& s = (*segments)[i];
+                double den = probe->x * s.d.y - probe->y * s.d.x;
+                if(den == 0.0){
+                    return std::numeric_limits<double>::infinity();
                 }
-            );
+                return ((double)s.a.x * s.d.y - (double)s.a.y * s.d.x) / den;
+            }
+            bool operator () (int i, int j) const{
+                return distance(i) < distance(j);
+            }
+        };
+    }
+
+    template <typename Beam, typename EdgeVisitor>
+    void RadialLight::castLightSweep(const EdgeVisitor& forEachEdge){
+        bool beamAngleBigEnough = !Beam::isLimited(m_beamAngle);
+        float start = beamAngleBigEnough ? 0.f : module360(getRotation() - m_beamAngle/2);
+        float span = beamAngleBigEnough ? 360.f : m_beamAngle;
+        sf::Vector2f castPoint = Transformable::getPosition();
+        float farRange = m_range*m_range;
+
+        std::vector<SweepSegment> segments;
+        std::vector<SweepEvent> events;
+        for(float a = 45.f; a < 360.f; a += 90.f){
+            float rel = module360(a - start);
+            if(rel > 0.f && rel < span){
+                events.push_back({rel, -1, false});
+            }
         }
-        if(!beamAngleBigEnough){
-            rays.emplace(rays.begin(), castPoint, bl1);
-            rays.emplace_back(castPoint, bl2);
+
+        sf::FloatRect lightBounds = getCastBounds();
+        auto visit = [&](const sfu::Line& s){
+            if( !lightBounds.intersects( s.getGlobalBounds() ) ){
+                CANDLE_PROFILE_COUNT(culledEdges, 1);
+                return;
+            }
+            sf::Vector2f p1 = s.m_origin - castPoint;
+            sf::Vector2f p2 = s.point(1.f) - castPoint;
+            float cross = p1.x * p2.y - p1.y * p2.x;
+            if(cross == 0.f){
+                return; // seen edge-on, casts no shadow
+            }
+            if(cross < 0.f){
+                std::swap(p1, p2);
+            }
+            float rb = module360(sfu::angle(p1) - start);
+            float re = module360(sfu::angle(p2) - start);
+            if(rb == re || (rb < re && rb >= span)){
+                return;
+            }
+            int id = segments.size();
+            segments.push_back({p1, p2 - p1});
+            if(rb > re && re > 0.f){
+                // Active from the start of the sweep
+                events.push_back({0.f, id, true});
+                events.push_back({re, id, false});
+                id = segments.size();
+                segments.push_back(segments.back());
+                events.push_back({rb, id, true});
+            }else{
+                events.push_back({rb, id, true});
+                if(rb < re){
+                    events.push_back({re, id, false});
+                }
+            }
+        };
+        forEachEdge(visit);
+        if(m_occluders){
+            // The sweep only knows edges, so the occluders are split in them
+            std::vector<unsigned int>& occluders = castScratch().m_occluders;
+            m_occluders->query(lightBounds, &castPoint, occluders);
+            m_occluders->visitEdges(occluders, castPoint, m_lodTolerance, visit);
         }
+        std::sort(events.begin(), events.end());
+
+        sf::Vector2<double> probe;
+        SweepCloser closer{&segments, &probe};
+        std::multiset<int, SweepCloser> active(closer);
+        std::vector<std::multiset<int, SweepCloser>::iterator> handles(segments.size(), active.end());
 
-        sf::Transform tr_i = trm.getInverse();
-        // keep only the ones within the area
         std::vector<sf::Vector2f> points;
-        points.reserve(rays.size());
-        for (auto& r: rays){
-            points.push_back(tr_i.transformPoint(castRay(begin, end,    r, m_range*m_range)));
+        points.reserve(events.size() + 2);
+        auto emit = [&](float rel, int segment){
+            float rad = (start + rel) * sfu::PI/180.f;
+            sf::Vector2f dir(std::cos(rad), std::sin(rad));
+            float t = farRange;
+            if(segment >= 0){
+                probe = sf::Vector2<double>(dir.x, dir.y);
+                t = std::max(0.f, std::min(farRange, (float)closer.distance(segment)));
+            }
+            points.push_back(castPoint + t * dir);
+        };
+        auto nearest = [&]()-> int {
+            return active.empty() ? -1 : *active.begin();
+        };
+
+        // Apply all the events with the same angle as events[i]
+        bool marker;
+        auto process = [&](size_t i)-> size_t {
+            float angle = events[i].angle;
+            size_t j = i;
+            marker = false;
+            while(j < events.size() && events[j].angle == angle){
+                if(events[j].segment < 0){
+                    marker = true;
+                }else if(!events[j].begin){
+                    active.erase(handles[events[j].segment]);
+                }
+                j++;
+            }
+            // Order the new segments just after this angle
+            float next = j < events.size() ? std::min(events[j].angle, span) : span;
+            double rad = (start + (angle + next)/2.0) * sfu::PI/180.0;
+            probe = sf::Vector2<double>(std::cos(rad), std::sin(rad));
+            for(size_t k = i; k < j; k++){
+                if(events[k].begin){
+                    handles[events[k].segment] = active.insert(events[k].segment);
+                }
+            }
+            return j;
+        };
+
+        size_t i = 0;
+        if(!events.empty() && events[0].angle == 0.f){
+            i = process(0);
+        }
+        emit(0.f, nearest());
+        while(i < events.size() && events[i].angle < span){
+            float angle = events[i].angle;
+            int before = nearest();
+            i = process(i);
+            int after = nearest();
+            if(before != after){
+                emit(angle, before);
+                emit(angle, after);
+            }else if(marker){
+                emit(angle, after);
+            }
         }
-        m_polygon.resize(points.size() + 1 + beamAngleBigEnough); // + center and last
+        emit(span, nearest());
+        m_hitAngles.clear();
+        m_hits.clear();
+        setPolygon<Beam>(points);
+    }
+
+    template <typename Beam>
+    void RadialLight::setPolygon(const std::vector<sf::Vector2f>& hits){
+        float scaledRange = m_range / BASE_RADIUS;
+        sf::Transform trm = Transformable::getTransform();
+        trm.scale(scaledRange, scaledRange, BASE_RADIUS, BASE_RADIUS);
+        sf::Transform tr_i = trm.getInverse();
+        bool beamAngleBigEnough = !Beam::isLimited(m_beamAngle);
+        auto castPoint = Transformable::getPosition();
+
+        m_polygon.resize(hits.size() + 1 + beamAngleBigEnough); // + center and last
         m_polygon[0].color = m_color;
         m_polygon[0].position = m_polygon[0].texCoords = tr_i.transformPoint(castPoint);
 #ifdef CANDLE_DEBUG
+        float bl1 = module360(getRotation() - m_beamAngle/2);
+        float bl2 = module360(getRotation() + m_beamAngle/2);
         float bl1rad = bl1 * sfu::PI/180.f;
         float bl2rad = bl2 * sfu::PI/180.f;
         sf::Vector2f al1(std::cos(bl1rad), std::sin(bl1rad));
         sf::Vector2f al2(std::cos(bl2rad), std::sin(bl2rad));
-        int d_n = points.size()*2 + 4;
+        int d_n = hits.size()*2 + 4;
         m_debug.resize(d_n);
         m_debug[d_n-1].color = m_debug[d_n-2].color = sf::Color::Cyan;
         m_debug[d_n-3].color = m_debug[d_n-4].color = sf::Color::Yellow;
@@ -241,8 +1021,8 @@ namespace candle{
         m_debug[d_n-2].position = tr_i.transformPoint(castPoint + m_range * al1);
         m_debug[d_n-4].position = tr_i.transformPoint(castPoint + m_range * al2);
 #endif
-        for(unsigned i=0; i < points.size(); i++){
-            sf::Vector2f p = points[i];
+        for(unsigned i=0; i < hits.size(); i++){
+            sf::Vector2f p = tr_i.transformPoint(hits[i]);
             m_polygon[i+1].position = p;
             m_polygon[i+1].texCoords = p;
             m_polygon[i+1].color = m_color;
@@ -253,8 +1033,22 @@ namespace candle{
 #endif
         }
         if(beamAngleBigEnough){
-            m_polygon[points.size()+1] = m_polygon[1];
+            m_polygon[hits.size()+1] = m_polygon[1];
         }
+        CANDLE_PROFILE_COUNT(vertices, m_polygon.getVertexCount());
+        m_castDirty = true;
+        m_bufferDirty = true;
     }
 
+    // The kernels of the RadialLightT
+    template void RadialLight::castLightWith<FullCircle>(const EdgeVector::iterator& begin, const EdgeVector::iterator& end);
+    template void RadialLight::castLightWith<FullCircle>(const EdgeBuffer& edges);
+    template void RadialLight::castLightWith<FullCircle>(const EdgeMesh& mesh);
+    template void RadialLight::castLightIndex<FullCircle>(const EdgeIndex& index, const std::vector<AngleRange>* window);
+    template bool RadialLight::castLightChangesWith<FullCircle>(const EdgeIndex& index, const std::vector<EdgeChange>& changes);
+    template void RadialLight::castLightWith<AnyBeam>(const EdgeVector::iterator& begin, const EdgeVector::iterator& end);
+    template void RadialLight::castLightWith<AnyBeam>(const EdgeBuffer& edges);
+    template void RadialLight::castLightWith<AnyBeam>(const EdgeMesh& mesh);
+    template void RadialLight::castLightIndex<AnyBeam>(const EdgeIndex& index, const std::vector<AngleRange>* window);
+    template bool RadialLight::castLightChangesWith<AnyBeam>(const EdgeIndex& index, const std::vector<EdgeChange>& changes);
 }
@@ -0,0 +1,267 @@
+#include "Candle/SoftwareLightingArea.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Candle/ThreadPool.hpp"
+
+namespace candle{
+    namespace{
+        // Rows rasterized by each task of the pool
+        const int BAND_HEIGHT = 32;
+
+        // Twice the signed area of the triangle a, b, p
+        float cross(const sf::Vector2f& a, const sf::Vector2f& b, const sf::Vector2f& p){
+            return (p.x - a.x) * (b.y - a.y) - (p.y - a.y) * (b.x - a.x);
+        }
+    }
+
+    SoftwareLightingArea::SoftwareLightingArea(LightingArea::Mode mode, const sf::Vector2f& position, const sf::Vector2f& size, Format format)
+        : m_mode(mode)
+        , m_format(format)
+        , m_size(std::max(0.f, std::ceil(size.x)), std::max(0.f, std::ceil(size.y)))
+        , m_color(sf::Color::White)
+        , m_opacity(1.f)
+        , m_pool(nullptr)
+        , m_triangles(sf::Triangles)
+        {
+        Transformable::setPosition(position);
+        m_pixels.resize(m_size.x * m_size.y * (m_format == RGBA ? 4 : 1));
+    }
+
+    sf::FloatRect SoftwareLightingArea::getLocalBounds() const{
+        return sf::FloatRect(0.f, 0.f, m_size.x, m_size.y);
+    }
+
+    sf::FloatRect SoftwareLightingArea::getGlobalBounds() const{
+        return Transformable::getTransform().transformRect(getLocalBounds());
+    }
+
+    void SoftwareLightingArea::setAreaColor(sf::Color color){
+        m_color = color;
+    }
+
+    sf::Color SoftwareLightingArea::getAreaColor() const{
+        return m_color;
+    }
+
+    void SoftwareLightingArea::setAreaOpacity(float opacity){
+        m_opacity = opacity;
+    }
+
+    float SoftwareLightingArea::getAreaOpacity() const{
+        return m_opacity;
+    }
+
+    void SoftwareLightingArea::setMode(LightingArea::Mode mode){
+        m_mode = mode;
+    }
+
+    LightingArea::Mode SoftwareLightingArea::getMode() const{
+        return m_mode;
+    }
+
+    void SoftwareLightingArea::setThreadPool(ThreadPool* pool){
+        m_pool = pool;
+    }
+
+    ThreadPool* SoftwareLightingArea::getThreadPool() const{
+        return m_pool;
+    }
+
+    void SoftwareLightingArea::clear(){
+        sf::Color color(m_color);
+        color.a *= m_opacity;
+        if(m_format == ALPHA){
+            std::fill(m_pixels.begin(), m_pixels.end(), color.a);
+            return;
+        }
+        for(std::size_t i = 0; i < m_pixels.size(); i += 4){
+            m_pixels[i] = color.r;
+            m_pixels[i+1] = color.g;
+            m_pixels[i+2] = color.b;
+            m_pixels[i+3] = color.a;
+        }
+    }
+
+    void SoftwareLightingArea::draw(const LightSource& light){
+        if(m_opacity <= 0.f || m_mode != LightingArea::FOG || m_pixels.empty()){
+            return;
+        }
+        m_triangles.clear();
+        light.appendTriangles(m_triangles);
+
+        // Only the pixels of the area within the bounds of the light are lit
+        sf::Transform toPixels = Transformable::getInverseTransform();
+        sf::FloatRect lightBounds = toPixels.transformRect(light.getGlobalBounds());
+        sf::IntRect clip(0, 0, m_size.x, m_size.y);
+        int left = std::floor(lightBounds.left);
+        int top = std::floor(lightBounds.top);
+        sf::IntRect lightRect(left, top,
+            (int)std::ceil(lightBounds.left + lightBounds.width) - left,
+            (int)std::ceil(lightBounds.top + lightBounds.height) - top);
+        if(!clip.intersects(lightRect, clip)){
+            return;
+        }
+
+        m_raster.clear();
+        for(std::size_t i = 0; i + 2 < m_triangles.getVertexCount(); i += 3){
+            sf::Vector2f p[3];
+            Triangle t;
+            for(int k = 0; k < 3; k++){
+                const sf::Vertex& v = m_triangles[i + k];
+                p[k] = toPixels.transformPoint(v.position);
+                t.alpha[k] = v.color.a / 255.f;
+                t.texCoords[k] = v.texCoords;
+            }
+            float area = cross(p[0], p[1], p[2]);
+            if(area == 0.f){
+                continue;
+            }
+            for(int k = 0; k < 3; k++){
+                // Counterclockwise in the edge functions, so they are all
+                // positive inside
+                sf::Vector2f a = area > 0.f ? p[(k+1) % 3] : p[(k+2) % 3];
+                sf::Vector2f b = area > 0.f ? p[(k+2) % 3] : p[(k+1) % 3];
+                RasterEdge& e = t.edges[k];
+                // The pixels exactly on an edge belong to only one of the
+                // triangles that share it, depending on its direction
+                e.owned = b.y > a.y || (b.y == a.y && b.x < a.x);
+                e.sign = 1.f;
+                if(!e.owned){
+                    std::swap(a, b);
+                    e.sign = -1.f;
+                }
+                e.origin = a;
+                e.direction = b - a;
+            }
+            t.inverseArea = 1.f / std::abs(area);
+            // Pixels whose center may be inside
+            float minX = std::min(p[0].x, std::min(p[1].x, p[2].x));
+            float minY = std::min(p[0].y, std::min(p[1].y, p[2].y));
+            float maxX = std::max(p[0].x, std::max(p[1].x, p[2].x));
+            float maxY = std::max(p[0].y, std::max(p[1].y, p[2].y));
+            int x0 = std::floor(minX - .5f) + 1;
+            int y0 = std::floor(minY - .5f) + 1;
+            sf::IntRect bounds(x0, y0,
+                (int)std::floor(maxX - .5f) + 1 - x0,
+                (int)std::floor(maxY - .5f) + 1 - y0);
+            if(bounds.width > 0 && bounds.height > 0 && bounds.intersects(clip, t.bounds)){
+                m_raster.push_back(t);
+            }
+        }
+        if(m_raster.empty()){
+            return;
+        }
+
+        int bandBegin = clip.top / BAND_HEIGHT;
+        int bandEnd = (clip.top + clip.height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+        auto rasterizeBand = [&](unsigned int i){
+            int bandTop = (bandBegin + i) * BAND_HEIGHT;
+            for(auto& t: m_raster){
+                rasterize(light, t, bandTop, bandTop + BAND_HEIGHT);
+            }
+        };
+        unsigned int bands = bandEnd - bandBegin;
+        if(m_pool != nullptr && bands > 1){
+            m_pool->parallelFor(bands, rasterizeBand);
+        }else{
+            for(unsigned int i = 0; i < bands; i++){
+                rasterizeBand(i);
+            }
+        }
+    }
+
+    void SoftwareLightingArea::rasterize(const LightSource& light, const Triangle& t, int top, int bottom){
+        top = std::max(top, t.bounds.top);
+        bottom = std::min(bottom, t.bounds.top + t.bounds.height);
+        int channels = m_format == RGBA ? 4 : 1;
+        for(int y = top; y < bottom; y++){
+            float py = y + .5f;
+            // Part of the edge functions that is the same for the whole row,
+            // and span of the row inside the three edges, widened by a
+            // pixel, since the exact test is done for each pixel
+            float rowTerm[3];
+            float lo = t.bounds.left, hi = t.bounds.left + t.bounds.width;
+            bool empty = false;
+            for(int k = 0; k < 3; k++){
+                const RasterEdge& e = t.edges[k];
+                rowTerm[k] = (py - e.origin.y) * e.direction.x;
+                float slope = e.sign * e.direction.y;
+                float offset = -e.sign * (e.origin.x * e.direction.y + rowTerm[k]);
+                if(slope > 0.f){
+                    lo = std::max(lo, -offset / slope - 1.5f);
+                }else if(slope < 0.f){
+                    hi = std::min(hi, -offset / slope + .5f);
+                }else if(offset < 0.f){
+                    empty = true;
+                }
+            }
+            if(empty || lo > hi){
+                continue;
+            }
+            int x0 = std::max(t.bounds.left, (int)std::floor(lo));
+            int x1 = std::min(t.bounds.left + t.bounds.width, (int)std::ceil(hi) + 1);
+            sf::Uint8* row = &m_pixels[(y * m_size.x) * channels + channels - 1];
+            for(int x = x0; x < x1; x++){
+                float px = x + .5f;
+                float w[3];
+                bool inside = true;
+                for(int k = 0; k < 3; k++){
+                    const RasterEdge& e = t.edges[k];
+                    w[k] = e.sign * ((px - e.origin.x) * e.direction.y - rowTerm[k]);
+                    inside &= w[k] > 0.f || (w[k] == 0.f && e.owned);
+                }
+                if(!inside){
+                    continue;
+                }
+                w[0] *= t.inverseArea;
+                w[1] *= t.inverseArea;
+                w[2] *= t.inverseArea;
+                float alpha = w[0] * t.alpha[0] + w[1] * t.alpha[1] + w[2] * t.alpha[2];
+                if(alpha <= 0.f){
+                    continue;
+                }
+                sf::Vector2f texCoords = w[0] * t.texCoords[0] + w[1] * t.texCoords[1] + w[2] * t.texCoords[2];
+                alpha = std::min(1.f, alpha * light.getFalloffAt(texCoords));
+                // Same as l_substractAlpha: the color is kept and the alpha
+                // is multiplied by one minus the one of the light
+                sf::Uint8& a = row[x * channels];
+                a = a * (1.f - alpha) + .5f;
+            }
+        }
+    }
+
+    sf::Vector2u SoftwareLightingArea::getSize() const{
+        return m_size;
+    }
+
+    SoftwareLightingArea::Format SoftwareLightingArea::getFormat() const{
+        return m_format;
+    }
+
+    const sf::Uint8* SoftwareLightingArea::getPixels() const{
+        return m_pixels.empty() ? nullptr : &m_pixels[0];
+    }
+
+    sf::Image SoftwareLightingArea::copyToImage() const{
+        sf::Image image;
+        if(m_format == RGBA){
+            image.create(m_size.x, m_size.y, getPixels());
+            return image;
+        }
+        std::vector<sf::Uint8> rgba(m_pixels.size() * 4);
+        for(std::size_t i = 0; i < m_pixels.size(); i++){
+            rgba[i*4] = m_color.r;
+            rgba[i*4+1] = m_color.g;
+            rgba[i*4+2] = m_color.b;
+            rgba[i*4+3] = m_pixels[i];
+        }
+        image.create(m_size.x, m_size.y, rgba.empty() ? nullptr : &rgba[0]);
+        return image;
+    }
+
+    bool SoftwareLightingArea::saveToFile(const std::string& filename) const{
+        return copyToImage().saveToFile(filename);
+    }
+}
@@ -0,0 +1,151 @@
+#include "Candle/Stats.hpp"
+
+#ifdef CANDLE_PROFILE
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace candle{
+    namespace{
+        struct ThreadStats;
+
+        // Guards the list of threads, the totals of the ones that ended and
+        // the callback. The scopes only take it when the callback changes.
+        std::mutex l_statsMutex;
+        std::vector<ThreadStats*> l_threads;
+        Stats l_endedStats;
+        ProfileCallback l_profileCallback;
+        std::atomic<unsigned long> l_callbackVersion(0);
+
+        // Totals of one thread. Its mutex is only contended while
+        // Stats::get or Stats::reset read them.
+        struct ThreadStats{
+            std::mutex mutex;
+            Stats stats;
+            ProfileCallback callback;
+            unsigned long callbackVersion;
+
+            ThreadStats()
+                : callbackVersion(0)
+                {
+                std::lock_guard<std::mutex> lock(l_statsMutex);
+                l_threads.push_back(this);
+            }
+
+            ~ThreadStats(){
+                std::lock_guard<std::mutex> lock(l_statsMutex);
+                l_endedStats += stats;
+                l_threads.erase(std::find(l_threads.begin(), l_threads.end(), this));
+            }
+        };
+
+        thread_local ThreadStats l_threadStats;
+        thread_local ProfileScope* l_currentScope = nullptr;
+    }
+
+    Stats::Stats()
+        : casts(0)
+        , edges(0)
+        , culledEdges(0)
+        , rays(0)
+        , intersectionTests(0)
+        , vertices(0)
+        , drawCalls(0)
+        , pixels(0)
+        , castTime(0)
+        , areaTime(0)
+        {}
+
+    Stats& Stats::operator+=(const Stats& s){
+        casts += s.casts;
+        edges += s.edges;
+        culledEdges += s.culledEdges;
+        rays += s.rays;
+        intersectionTests += s.intersectionTests;
+        vertices += s.vertices;
+        drawCalls += s.drawCalls;
+        pixels += s.pixels;
+        castTime += s.castTime;
+        areaTime += s.areaTime;
+        return *this;
+    }
+
+    Stats Stats::get(){
+        std::lock_guard<std::mutex> lock(l_statsMutex);
+        Stats total = l_endedStats;
+        for(ThreadStats* thread: l_threads){
+            std::lock_guard<std::mutex> threadLock(thread->mutex);
+            total += thread->stats;
+        }
+        return total;
+    }
+
+    Stats Stats::reset(){
+        std::lock_guard<std::mutex> lock(l_statsMutex);
+        Stats last = l_endedStats;
+        l_endedStats = Stats();
+        for(ThreadStats* thread: l_threads){
+            std::lock_guard<std::mutex> threadLock(thread->mutex);
+            last += thread->stats;
+            thread->stats = Stats();
+        }
+        return last;
+    }
+
+    void setProfileCallback(const ProfileCallback& callback){
+        std::lock_guard<std::mutex> lock(l_statsMutex);
+        l_profileCallback = callback;
+        l_callbackVersion++;
+    }
+
+    ProfileScope::ProfileScope(ProfileEvent::Type type, const void* object)
+        : m_parent(l_currentScope)
+        {
+        m_event.type = type;
+        m_event.object = object;
+        l_currentScope = this;
+        m_event.begin = std::chrono::steady_clock::now();
+    }
+
+    ProfileScope::~ProfileScope(){
+        m_event.end = std::chrono::steady_clock::now();
+        l_currentScope = m_parent;
+        auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(m_event.end - m_event.begin);
+        if(m_event.type == ProfileEvent::CAST_LIGHT){
+            m_event.stats.casts = 1;
+            m_event.stats.castTime = duration;
+        }else{
+            m_event.stats.areaTime = duration;
+        }
+        // The time of a nested scope is already in the one of its parent
+        Stats global = m_event.stats;
+        if(m_parent != nullptr){
+            global.castTime = global.areaTime = std::chrono::nanoseconds(0);
+        }
+        ThreadStats& thread = l_threadStats;
+        {
+            std::lock_guard<std::mutex> lock(thread.mutex);
+            thread.stats += global;
+        }
+        // Each thread keeps its own copy of the callback, and only copies
+        // it again when it changes
+        if(thread.callbackVersion != l_callbackVersion){
+            std::lock_guard<std::mutex> lock(l_statsMutex);
+            thread.callback = l_profileCallback;
+            thread.callbackVersion = l_callbackVersion;
+        }
+        if(thread.callback){
+            thread.callback(m_event);
+        }
+    }
+
+    void ProfileScope::count(unsigned long Stats::*counter, unsigned long n){
+        if(l_currentScope != nullptr){
+            l_currentScope->m_event.stats.*counter += n;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,126 @@
+#include "Candle/ThreadPool.hpp"
+
+namespace candle{
+    ThreadPool::ThreadPool(unsigned int threads)
+        : m_task(nullptr)
+        , m_generation(0)
+        , m_running(0)
+        , m_stop(false)
+        {
+        if(threads == 0){
+            threads = std::thread::hardware_concurrency();
+        }
+        m_slots = threads > 0 ? threads : 1;
+        m_ranges.reset(new Range[m_slots]);
+        for(unsigned int i = 0; i < m_slots; i++){
+            m_ranges[i].begin = m_ranges[i].end = 0;
+        }
+        // The last slot is for the thread that calls parallelFor
+        for(unsigned int i = 0; i + 1 < m_slots; i++){
+            m_threads.emplace_back(&ThreadPool::loop, this, i);
+        }
+    }
+
+    ThreadPool::~ThreadPool(){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_start.notify_all();
+        for(auto& t: m_threads){
+            t.join();
+        }
+    }
+
+    unsigned int ThreadPool::getThreadCount() const{
+        return m_slots;
+    }
+
+    bool ThreadPool::next(unsigned int slot, unsigned int& task){
+        Range& own = m_ranges[slot];
+        {
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if(own.begin < own.end){
+                task = own.begin++;
+                return true;
+            }
+        }
+        for(unsigned int k = 1; k < m_slots; k++){
+            Range& victim = m_ranges[(slot + k) % m_slots];
+            unsigned int begin, end;
+            {
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if(victim.begin >= victim.end){
+                    continue;
+                }
+                // Take the second half, the owner keeps taking from the front
+                begin = victim.end - (victim.end - victim.begin + 1) / 2;
+                end = victim.end;
+                victim.end = begin;
+            }
+            std::lock_guard<std::mutex> lock(own.mutex);
+            own.begin = begin + 1;
+            own.end = end;
+            task = begin;
+            return true;
+        }
+        return false;
+    }
+
+    void ThreadPool::work(unsigned int slot){
+        unsigned int task;
+        while(next(slot, task)){
+            (*m_task)(task);
+        }
+    }
+
+    void ThreadPool::loop(unsigned int slot){
+        unsigned long generation = 0;
+        while(true){
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_start.wait(lock, [&]{ return m_stop || m_generation != generation; });
+                if(m_stop){
+                    return;
+                }
+                generation = m_generation;
+            }
+            work(slot);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_running--;
+            }
+            m_finish.notify_one();
+        }
+    }
+
+    void ThreadPool::parallelFor(unsigned int count, const std::function<void(unsigned int)>& task){
+        if(count == 0){
+            return;
+        }
+        if(m_threads.empty() || count == 1){
+            for(unsigned int i = 0; i < count; i++){
+                task(i);
+            }
+            return;
+        }
+        for(unsigned int i = 0; i < m_slots; i++){
+            std::lock_guard<std::mutex> lock(m_ranges[i].mutex);
+            m_ranges[i].begin = (unsigned long)count * i / m_slots;
+            m_ranges[i].end = (unsigned long)count * (i + 1) / m_slots;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_task = &task;
+            m_running = m_threads.size();
+            m_generation++;
+        }
+        m_start.notify_all();
+        work(m_slots - 1);
+        // Every thread has to leave the job, even if there is nothing left
+        // to steal, before the task goes out of scope
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_finish.wait(lock, [&]{ return m_running == 0; });
+        m_task = nullptr;
+    }
+}
@@ -0,0 +1,222 @@
+#include "Candle/TiledLightingArea.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace candle{
+    TiledLightingArea::TiledLightingArea(LightingArea::Mode mode, const sf::Vector2f& position, const sf::Vector2f& size, unsigned int tileSize)
+        : m_mode(mode)
+        , m_size(size)
+        , m_tileSize(std::max(1u, std::min(tileSize, sf::Texture::getMaximumSize())))
+        , m_maxInactiveTiles(0)
+        , m_color(sf::Color::White)
+        , m_opacity(1.f)
+        , m_resolutionScale(1.f)
+        , m_frame(0)
+        {
+        Transformable::setPosition(position);
+    }
+
+    sf::FloatRect TiledLightingArea::getLocalBounds() const{
+        return sf::FloatRect(0.f, 0.f, m_size.x, m_size.y);
+    }
+
+    sf::FloatRect TiledLightingArea::getGlobalBounds() const{
+        return Transformable::getTransform().transformRect(getLocalBounds());
+    }
+
+    unsigned int TiledLightingArea::getTileSize() const{
+        return m_tileSize;
+    }
+
+    unsigned int TiledLightingArea::getTileCount() const{
+        return m_tiles.size();
+    }
+
+    sf::IntRect TiledLightingArea::getTileRange(const sf::FloatRect& rect) const{
+        sf::FloatRect local = Transformable::getInverseTransform().transformRect(rect);
+        float side = m_tileSize;
+        int columns = std::ceil(m_size.x / side);
+        int rows = std::ceil(m_size.y / side);
+        int left = std::max(0, (int)std::floor(local.left / side));
+        int top = std::max(0, (int)std::floor(local.top / side));
+        int right = std::min(columns, (int)std::ceil((local.left + local.width) / side));
+        int bottom = std::min(rows, (int)std::ceil((local.top + local.height) / side));
+        return sf::IntRect(left, top, right - left, bottom - top);
+    }
+
+    void TiledLightingArea::placeTile(const TileKey& key, LightingArea& area) const{
+        // The transform of the area, followed by the offset of the tile
+        sf::Vector2f offset(key.first * (float)m_tileSize, key.second * (float)m_tileSize);
+        area.setPosition(Transformable::getPosition());
+        area.setRotation(Transformable::getRotation());
+        area.setScale(Transformable::getScale());
+        area.setOrigin(Transformable::getOrigin() - offset);
+    }
+
+    template <typename Function>
+    void TiledLightingArea::forEachActiveTile(Function f){
+        for(auto& tile: m_tiles){
+            if(tile.second.active){
+                placeTile(tile.first, *tile.second.area);
+                f(*tile.second.area);
+            }
+        }
+    }
+
+    template <typename Function>
+    void TiledLightingArea::forEachTile(const sf::FloatRect& rect, bool activeOnly, Function f){
+        sf::IntRect range = getTileRange(rect);
+        for(int y = range.top; y < range.top + range.height; y++){
+            for(int x = range.left; x < range.left + range.width; x++){
+                auto it = m_tiles.find(TileKey(x, y));
+                if(it != m_tiles.end() && (it->second.active || !activeOnly)){
+                    placeTile(it->first, *it->second.area);
+                    f(*it->second.area);
+                }
+            }
+        }
+    }
+
+    void TiledLightingArea::setActiveRect(const sf::FloatRect& rect){
+        m_frame++;
+        for(auto& tile: m_tiles){
+            tile.second.active = false;
+        }
+        sf::IntRect range = getTileRange(rect);
+        for(int y = range.top; y < range.top + range.height; y++){
+            for(int x = range.left; x < range.left + range.width; x++){
+                Tile& tile = m_tiles[TileKey(x, y)];
+                if(!tile.area){
+                    // The last row and column may be smaller
+                    sf::Vector2f size(
+                        std::min((float)m_tileSize, m_size.x - x * m_tileSize),
+                        std::min((float)m_tileSize, m_size.y - y * m_tileSize));
+                    tile.area.reset(new LightingArea(m_mode, sf::Vector2f(0.f, 0.f), size));
+                    tile.area->setAreaColor(m_color);
+                    tile.area->setAreaOpacity(m_opacity);
+                    tile.area->setResolutionScale(m_resolutionScale);
+                    tile.area->clear();
+                }
+                tile.active = true;
+                tile.lastActive = m_frame;
+            }
+        }
+        evictTiles();
+    }
+
+    void TiledLightingArea::setActiveView(const sf::View& view){
+        setActiveRect(view.getInverseTransform().transformRect(sf::FloatRect(-1.f, -1.f, 2.f, 2.f)));
+    }
+
+    void TiledLightingArea::evictTiles(){
+        std::vector<std::pair<unsigned long, TileKey>> inactive;
+        for(auto& tile: m_tiles){
+            if(!tile.second.active){
+                inactive.push_back(std::make_pair(tile.second.lastActive, tile.first));
+            }
+        }
+        if(inactive.size() <= m_maxInactiveTiles){
+            return;
+        }
+        std::sort(inactive.begin(), inactive.end());
+        for(unsigned int i = 0; i < inactive.size() - m_maxInactiveTiles; i++){
+            m_tiles.erase(inactive[i].second);
+        }
+    }
+
+    void TiledLightingArea::setMaxInactiveTiles(unsigned int count){
+        m_maxInactiveTiles = count;
+        evictTiles();
+    }
+
+    unsigned int TiledLightingArea::getMaxInactiveTiles() const{
+        return m_maxInactiveTiles;
+    }
+
+    void TiledLightingArea::setAreaColor(sf::Color color){
+        m_color = color;
+        for(auto& tile: m_tiles){
+            tile.second.area->setAreaColor(color);
+        }
+    }
+
+    sf::Color TiledLightingArea::getAreaColor() const{
+        return m_color;
+    }
+
+    void TiledLightingArea::setAreaOpacity(float opacity){
+        m_opacity = opacity;
+        for(auto& tile: m_tiles){
+            tile.second.area->setAreaOpacity(opacity);
+        }
+    }
+
+    float TiledLightingArea::getAreaOpacity() const{
+        return m_opacity;
+    }
+
+    void TiledLightingArea::setMode(LightingArea::Mode mode){
+        m_mode = mode;
+        for(auto& tile: m_tiles){
+            tile.second.area->setMode(mode);
+        }
+    }
+
+    LightingArea::Mode TiledLightingArea::getMode() const{
+        return m_mode;
+    }
+
+    void TiledLightingArea::setResolutionScale(float scale){
+        if(!(scale > 0.f)){
+            return;
+        }
+        scale = std::min(scale, 1.f);
+        for(auto& tile: m_tiles){
+            tile.second.area->setResolutionScale(scale);
+        }
+        m_resolutionScale = scale;
+    }
+
+    float TiledLightingArea::getResolutionScale() const{
+        return m_resolutionScale;
+    }
+
+    void TiledLightingArea::clear(){
+        forEachActiveTile([](LightingArea& area){ area.clear(); });
+    }
+
+    void TiledLightingArea::invalidate(const sf::FloatRect& rect){
+        forEachTile(rect, false, [&rect](LightingArea& area){ area.invalidate(rect); });
+    }
+
+    void TiledLightingArea::invalidate(const LightSource& light){
+        invalidate(light.getGlobalBounds());
+    }
+
+    void TiledLightingArea::clearDirty(){
+        forEachActiveTile([](LightingArea& area){ area.clearDirty(); });
+    }
+
+    void TiledLightingArea::draw(const LightSource& light){
+        forEachTile(light.getGlobalBounds(), true, [&light](LightingArea& area){ area.draw(light); });
+    }
+
+    void TiledLightingArea::draw(const LightBatch& batch){
+        forEachActiveTile([&batch](LightingArea& area){ area.draw(batch); });
+    }
+
+    void TiledLightingArea::display(){
+        forEachActiveTile([](LightingArea& area){ area.display(); });
+    }
+
+    void TiledLightingArea::draw(sf::RenderTarget& t, sf::RenderStates s) const{
+        for(auto& tile: m_tiles){
+            if(tile.second.active){
+                placeTile(tile.first, *tile.second.area);
+                t.draw(*tile.second.area, s);
+            }
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#include "Candle/VertexSink.hpp"
+
+namespace candle{
+    const std::size_t VertexSink::FULL;
+
+    VertexSink::VertexSink()
+        : m_vertices(nullptr)
+        , m_capacity(0)
+        , m_size(0)
+        , m_required(0)
+        {}
+
+    VertexSink::VertexSink(sf::Vertex* vertices, std::size_t capacity)
+        : m_vertices(vertices)
+        , m_capacity(capacity)
+        , m_size(0)
+        , m_required(0)
+        {}
+
+    void VertexSink::reset(sf::Vertex* vertices, std::size_t capacity){
+        m_vertices = vertices;
+        m_capacity = capacity;
+        clear();
+    }
+
+    void VertexSink::clear(){
+        m_size = 0;
+        m_required = 0;
+    }
+
+    std::size_t VertexSink::allocate(std::size_t count){
+        m_required += count;
+        if(count > m_capacity - m_size){
+            return FULL;
+        }
+        std::size_t offset = m_size;
+        m_size += count;
+        return offset;
+    }
+
+    sf::Vertex* VertexSink::getVertices() const{
+        return m_vertices;
+    }
+
+    std::size_t VertexSink::getSize() const{
+        return m_size;
+    }
+
+    std::size_t VertexSink::getCapacity() const{
+        return m_capacity;
+    }
+
+    std::size_t VertexSink::getRequiredSize() const{
+        return m_required;
+    }
+}
@@ -0,0 +1,108 @@
+#include "Candle/Visibility.hpp"
+
+#include <algorithm>
+
+#include "Candle/CastScratch.hpp"
+#include "Candle/geometry/Line.hpp"
+#include "Candle/geometry/Vector2.hpp"
+
+namespace candle{
+    // Distance before the target point at which the edges stop blocking
+    // it, so the points on an edge are visible.
+    const float END_TOLERANCE = 1e-3f;
+
+    namespace{
+        template <typename Iterator>
+        bool segmentClear(const sf::Vector2f& from, const sf::Vector2f& to, const Iterator& begin, const Iterator& end){
+            float distance = sfu::magnitude(to - from);
+            if(distance <= END_TOLERANCE){
+                return true;
+            }
+            // With a direction of the length of the segment, the parameter
+            // of the hit is the fraction of the way to the target
+            sfu::Line ray(from, to);
+            float tEnd = 1.f - END_TOLERANCE / distance;
+            for(auto it = begin; it != end; it++){
+                float t;
+                if(sfu::intersectSegmentRay(*it, ray, t) && t < tEnd){
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    bool isVisible(const sf::Vector2f& from, const sf::Vector2f& to, const EdgeVector::iterator& begin, const EdgeVector::iterator& end){
+        return segmentClear(from, to, begin, end);
+    }
+
+    bool isVisible(const sf::Vector2f& from, const sf::Vector2f& to, const EdgeIndex& edges){
+        float distance = sfu::magnitude(to - from);
+        if(distance <= END_TOLERANCE){
+            return true;
+        }
+        float t;
+        return !edges.castRay(sfu::Line(from, to), distance - END_TOLERANCE, t);
+    }
+
+    bool isVisible(const sf::Vector2f& from, const sf::Vector2f& to, const EdgeBuffer& edges){
+        float distance = sfu::magnitude(to - from);
+        if(distance <= END_TOLERANCE){
+            return true;
+        }
+        float maxRange = distance - END_TOLERANCE;
+        return castRayDistance(edges, sfu::Line(from, to), maxRange) >= maxRange;
+    }
+
+    void visibleSet(const sf::Vector2f& from, const std::vector<sf::Vector2f>& points, const EdgeVector::iterator& begin, const EdgeVector::iterator& end, std::vector<unsigned int>& visible){
+        visible.clear();
+        if(points.empty()){
+            return;
+        }
+        // Only the edges that touch the bounds of all the segments can
+        // block any of them
+        float left = from.x, top = from.y, right = from.x, bottom = from.y;
+        for(auto& p: points){
+            left = std::min(left, p.x);
+            top = std::min(top, p.y);
+            right = std::max(right, p.x);
+            bottom = std::max(bottom, p.y);
+        }
+        CastScratch& scratch = CastScratch::getThreadScratch();
+        scratch.beginCast();
+        std::vector<sfu::Line>& edges = scratch.m_edges;
+        edges.clear();
+        for(auto it = begin; it != end; it++){
+            sf::Vector2f a = it->m_origin;
+            sf::Vector2f b = it->point(1.f);
+            if(std::max(a.x, b.x) >= left && std::min(a.x, b.x) <= right
+                && std::max(a.y, b.y) >= top && std::min(a.y, b.y) <= bottom){
+                edges.push_back(*it);
+            }
+        }
+        for(unsigned int i = 0; i < points.size(); i++){
+            if(segmentClear(from, points[i], edges.cbegin(), edges.cend())){
+                visible.push_back(i);
+            }
+        }
+        scratch.endCast();
+    }
+
+    void visibleSet(const sf::Vector2f& from, const std::vector<sf::Vector2f>& points, const EdgeIndex& edges, std::vector<unsigned int>& visible){
+        visible.clear();
+        for(unsigned int i = 0; i < points.size(); i++){
+            if(isVisible(from, points[i], edges)){
+                visible.push_back(i);
+            }
+        }
+    }
+
+    void visibleSet(const sf::Vector2f& from, const std::vector<sf::Vector2f>& points, const EdgeBuffer& edges, std::vector<unsigned int>& visible){
+        visible.clear();
+        for(unsigned int i = 0; i < points.size(); i++){
+            if(isVisible(from, points[i], edges)){
+                visible.push_back(i);
+            }
+        }
+    }
+}
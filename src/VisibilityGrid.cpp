@@ -0,0 +1,329 @@
+#include "Candle/VisibilityGrid.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Candle/geometry/Vector2.hpp"
+
+namespace candle{
+    namespace{
+        const unsigned int WORD_BITS = 64;
+        const std::size_t HEADER_SIZE = 8;
+
+        // Twice the signed area of the triangle a, b, c
+        float signedArea(const sf::Vector2f& a, const sf::Vector2f& b, const sf::Vector2f& c){
+            return (c.x - a.x) * (b.y - a.y) - (c.y - a.y) * (b.x - a.x);
+        }
+
+        unsigned int countBits(std::uint64_t w){
+            w = w - ((w >> 1) & 0x5555555555555555ull);
+            w = (w & 0x3333333333333333ull) + ((w >> 2) & 0x3333333333333333ull);
+            w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0full;
+            return (w * 0x0101010101010101ull) >> 56;
+        }
+
+        void writeUint32(sf::Uint8* out, sf::Uint32 n){
+            for(int i = 0; i < 4; i++){
+                out[i] = (n >> (8 * i)) & 0xff;
+            }
+        }
+
+        sf::Uint32 readUint32(const sf::Uint8* in){
+            sf::Uint32 n = 0;
+            for(int i = 0; i < 4; i++){
+                n |= (sf::Uint32)in[i] << (8 * i);
+            }
+            return n;
+        }
+    }
+
+    VisibilityGrid::VisibilityGrid(const sf::Vector2f& position, const sf::Vector2u& size, float cellSize)
+        : m_position(position)
+        , m_size(size)
+        , m_cellSize(cellSize)
+        , m_wordsPerRow((size.x + WORD_BITS - 1) / WORD_BITS)
+        , m_words(m_wordsPerRow * size.y, 0)
+        , m_dirtyTop(0)
+        , m_dirtyBottom(size.y)
+        , m_triangles(sf::Triangles)
+        {
+    }
+
+    const sf::Vector2f& VisibilityGrid::getPosition() const{
+        return m_position;
+    }
+
+    sf::Vector2u VisibilityGrid::getSize() const{
+        return m_size;
+    }
+
+    float VisibilityGrid::getCellSize() const{
+        return m_cellSize;
+    }
+
+    sf::FloatRect VisibilityGrid::getGlobalBounds() const{
+        return sf::FloatRect(m_position.x, m_position.y, m_size.x * m_cellSize, m_size.y * m_cellSize);
+    }
+
+    void VisibilityGrid::clear(){
+        std::fill(m_words.begin(), m_words.end(), 0);
+        markDirty(0, m_size.y);
+    }
+
+    void VisibilityGrid::reveal(const LightSource& light){
+        sf::FloatRect bounds = light.getGlobalBounds();
+        if(m_words.empty() || !bounds.intersects(getGlobalBounds())){
+            return;
+        }
+        m_triangles.clear();
+        light.appendTriangles(m_triangles);
+        float inverseCell = 1.f / m_cellSize;
+        // Cells whose center is within the bounds of the light
+        sf::Vector2f low = (sf::Vector2f(bounds.left, bounds.top) - m_position) * inverseCell;
+        sf::Vector2f high = low + sf::Vector2f(bounds.width, bounds.height) * inverseCell;
+        int left = std::max(0, (int)std::ceil(low.x - .5f));
+        int right = std::min((int)m_size.x, (int)std::floor(high.x - .5f) + 1);
+        int top = std::max(0, (int)std::ceil(low.y - .5f));
+        int bottom = std::min((int)m_size.y, (int)std::floor(high.y - .5f) + 1);
+        sf::Vector2f circleCenter;
+        float circleRadius;
+        bool hasCircle = light.getFalloffCircle(circleCenter, circleRadius);
+        for(std::size_t i = 0; i + 2 < m_triangles.getVertexCount(); i += 3){
+            // In cell units, counterclockwise in the edge functions
+            sf::Vector2f p[3];
+            sf::Vector2f texCoords[3];
+            for(int k = 0; k < 3; k++){
+                p[k] = (m_triangles[i + k].position - m_position) * inverseCell;
+                texCoords[k] = m_triangles[i + k].texCoords;
+            }
+            float area = signedArea(p[0], p[1], p[2]);
+            if(area == 0.f){
+                continue;
+            }
+            if(area < 0.f){
+                std::swap(p[1], p[2]);
+                std::swap(texCoords[1], texCoords[2]);
+                area = -area;
+            }
+            // Column where each edge crosses a row, as a function of it
+            float crossX[3], crossStep[3];
+            for(int k = 0; k < 3; k++){
+                const sf::Vector2f& a = p[k];
+                const sf::Vector2f& b = p[(k+1) % 3];
+                crossStep[k] = a.y == b.y ? 0.f : (b.x - a.x) / (b.y - a.y);
+                crossX[k] = a.x - .5f - a.y * crossStep[k];
+            }
+            // The polygon of a light may be bigger than the part that it
+            // lights, which is given by its falloff. The texture coordinates
+            // change linearly, by texStep from cell to cell of a row
+            sf::Vector2f texStep = ((p[2].y - p[1].y) * texCoords[0]
+                + (p[0].y - p[2].y) * texCoords[1]
+                + (p[1].y - p[0].y) * texCoords[2]) / area;
+            sf::Vector2f texStepY = ((p[1].x - p[2].x) * texCoords[0]
+                + (p[2].x - p[0].x) * texCoords[1]
+                + (p[0].x - p[1].x) * texCoords[2]) / area;
+            sf::Vector2f c(.5f, 0.f);
+            sf::Vector2f texOrigin = (signedArea(p[1], p[2], c) * texCoords[0]
+                + signedArea(p[2], p[0], c) * texCoords[1]
+                + signedArea(p[0], p[1], c) * texCoords[2]) / area;
+            float stepSquared = sfu::dot(texStep, texStep);
+
+            float minY = std::min(p[0].y, std::min(p[1].y, p[2].y));
+            float maxY = std::max(p[0].y, std::max(p[1].y, p[2].y));
+            // Clamped as floats, since the far vertices may be out of the
+            // range of an int
+            int y0 = std::max((float)top, std::ceil(minY - .5f));
+            int y1 = std::min((float)bottom, std::floor(maxY - .5f) + 1);
+            for(int y = y0; y < y1; y++){
+                // Span of cell centers of the row inside the three edges,
+                // compared before rounding for the same reason
+                float cy = y + .5f;
+                int x0 = left, x1 = right;
+                for(int k = 0; k < 3 && x0 < x1; k++){
+                    const sf::Vector2f& a = p[k];
+                    const sf::Vector2f& b = p[(k+1) % 3];
+                    if(a.y == b.y){
+                        if((cy - a.y) * (b.x - a.x) > 0.f){
+                            x1 = x0;
+                        }
+                        continue;
+                    }
+                    float t = crossX[k] + cy * crossStep[k];
+                    if(b.y > a.y && t > x0){
+                        x0 = t >= x1 ? x1 : (int)std::ceil(t);
+                    }else if(b.y < a.y && t < x1 - 1){
+                        x1 = t < x0 ? x0 : (int)std::floor(t) + 1;
+                    }
+                }
+                if(x0 >= x1){
+                    continue;
+                }
+                sf::Vector2f rowTexCoords = texOrigin + cy * texStepY;
+                if(hasCircle){
+                    // Cells x with |rowTexCoords + x*texStep - center| < radius
+                    sf::Vector2f u = rowTexCoords - circleCenter;
+                    float half = sfu::dot(u, texStep);
+                    float rest = sfu::dot(u, u) - circleRadius * circleRadius;
+                    float discriminant = half * half - stepSquared * rest;
+                    if(stepSquared == 0.f){
+                        x1 = rest < 0.f ? x1 : x0;
+                    }else if(discriminant <= 0.f){
+                        x1 = x0;
+                    }else{
+                        float root = std::sqrt(discriminant);
+                        float t0 = (-half - root) / stepSquared;
+                        float t1 = (-half + root) / stepSquared;
+                        if(t0 >= x0){
+                            x0 = t0 >= x1 ? x1 : (int)std::floor(t0) + 1;
+                        }
+                        if(t1 <= x1 - 1){
+                            x1 = t1 <= x0 ? x0 : (int)std::ceil(t1);
+                        }
+                    }
+                }else{
+                    // From the first to the last lit cell of the span
+                    auto lit = [&](int x){
+                        return light.getFalloffAt(rowTexCoords + (float)x * texStep) > 0.f;
+                    };
+                    while(x0 < x1 && !lit(x0)){
+                        x0++;
+                    }
+                    while(x0 < x1 && !lit(x1 - 1)){
+                        x1--;
+                    }
+                }
+                if(x0 < x1){
+                    fillSpan(y, x0, x1);
+                }
+            }
+        }
+    }
+
+    void VisibilityGrid::fillSpan(unsigned int y, int x0, int x1){
+        // Whole words at a time, with a mask for the partial ones at the ends
+        Word* row = &m_words[y * m_wordsPerRow];
+        unsigned int first = x0 / WORD_BITS;
+        unsigned int last = (x1 - 1) / WORD_BITS;
+        Word changed = 0;
+        for(unsigned int w = first; w <= last; w++){
+            Word mask = ~(Word)0;
+            if(w == first){
+                mask &= ~(Word)0 << (x0 % WORD_BITS);
+            }
+            if(w == last && x1 % WORD_BITS != 0){
+                mask &= ~(Word)0 >> (WORD_BITS - x1 % WORD_BITS);
+            }
+            changed |= mask & ~row[w];
+            row[w] |= mask;
+        }
+        if(changed != 0){
+            markDirty(y, y + 1);
+        }
+    }
+
+    void VisibilityGrid::markDirty(unsigned int top, unsigned int bottom){
+        if(m_dirtyTop >= m_dirtyBottom){
+            m_dirtyTop = top;
+            m_dirtyBottom = bottom;
+        }else{
+            m_dirtyTop = std::min(m_dirtyTop, top);
+            m_dirtyBottom = std::max(m_dirtyBottom, bottom);
+        }
+    }
+
+    bool VisibilityGrid::isExplored(unsigned int x, unsigned int y) const{
+        if(x >= m_size.x || y >= m_size.y){
+            return false;
+        }
+        return (m_words[y * m_wordsPerRow + x / WORD_BITS] >> (x % WORD_BITS)) & 1;
+    }
+
+    bool VisibilityGrid::isExplored(const sf::Vector2f& point) const{
+        sf::Vector2f cell = (point - m_position) / m_cellSize;
+        if(cell.x < 0.f || cell.y < 0.f){
+            return false;
+        }
+        return isExplored((unsigned int)cell.x, (unsigned int)cell.y);
+    }
+
+    unsigned long VisibilityGrid::getExploredCount() const{
+        unsigned long count = 0;
+        for(Word w: m_words){
+            count += countBits(w);
+        }
+        return count;
+    }
+
+    std::vector<sf::Uint8> VisibilityGrid::serialize() const{
+        std::size_t rowBytes = (m_size.x + 7) / 8;
+        std::vector<sf::Uint8> data(HEADER_SIZE + rowBytes * m_size.y, 0);
+        writeUint32(&data[0], m_size.x);
+        writeUint32(&data[4], m_size.y);
+        for(unsigned int y = 0; y < m_size.y; y++){
+            const Word* row = &m_words[y * m_wordsPerRow];
+            sf::Uint8* out = &data[HEADER_SIZE + y * rowBytes];
+            for(std::size_t i = 0; i < rowBytes; i++){
+                out[i] = (row[i / 8] >> (8 * (i % 8))) & 0xff;
+            }
+        }
+        return data;
+    }
+
+    bool VisibilityGrid::deserialize(const sf::Uint8* data, std::size_t size){
+        std::size_t rowBytes = (m_size.x + 7) / 8;
+        if(size != HEADER_SIZE + rowBytes * m_size.y
+            || readUint32(data) != m_size.x
+            || readUint32(data + 4) != m_size.y){
+            return false;
+        }
+        std::fill(m_words.begin(), m_words.end(), 0);
+        for(unsigned int y = 0; y < m_size.y; y++){
+            Word* row = &m_words[y * m_wordsPerRow];
+            const sf::Uint8* in = data + HEADER_SIZE + y * rowBytes;
+            for(std::size_t i = 0; i < rowBytes; i++){
+                row[i / 8] |= (Word)in[i] << (8 * (i % 8));
+            }
+            // Bits beyond the last column must stay clear for the count
+            if(m_size.x % WORD_BITS != 0){
+                row[m_wordsPerRow - 1] &= ~(Word)0 >> (WORD_BITS - m_size.x % WORD_BITS);
+            }
+        }
+        markDirty(0, m_size.y);
+        return true;
+    }
+
+    bool VisibilityGrid::isDirty() const{
+        return m_dirtyTop < m_dirtyBottom;
+    }
+
+    void VisibilityGrid::updateTexture(sf::Texture& texture, const sf::Color& hidden, const sf::Color& explored){
+        if(m_words.empty()){
+            return;
+        }
+        if(texture.getSize() != m_size || hidden != m_hiddenColor || explored != m_exploredColor){
+            texture.create(m_size.x, m_size.y);
+            m_hiddenColor = hidden;
+            m_exploredColor = explored;
+            markDirty(0, m_size.y);
+        }
+        if(!isDirty()){
+            return;
+        }
+        unsigned int rows = m_dirtyBottom - m_dirtyTop;
+        m_rowPixels.resize(m_size.x * rows * 4);
+        sf::Uint8* out = &m_rowPixels[0];
+        for(unsigned int y = m_dirtyTop; y < m_dirtyBottom; y++){
+            const Word* row = &m_words[y * m_wordsPerRow];
+            for(unsigned int x = 0; x < m_size.x; x++){
+                const sf::Color& c = (row[x / WORD_BITS] >> (x % WORD_BITS)) & 1 ? explored : hidden;
+                out[0] = c.r;
+                out[1] = c.g;
+                out[2] = c.b;
+                out[3] = c.a;
+                out += 4;
+            }
+        }
+        texture.update(&m_rowPixels[0], m_size.x, rows, 0, m_dirtyTop);
+        m_dirtyTop = m_dirtyBottom = 0;
+    }
+}